@@ -38,14 +38,63 @@ int Chunk::addConstant(Value value) {
     return (int)this->constants.count - 1;
 }
 
+void Chunk::truncate(size_t codeCount, size_t constantCount) {
+    code.resize(codeCount);
+    count = codeCount;
+    
+    while(lineCount > 0 && lines.back().start >= codeCount) {
+        lines.pop_back();
+        lineCount--;
+    }
+    
+    constants.values.resize(constantCount);
+    constants.count = constantCount;
+}
+
+size_t SwitchTable::lookup(Value value) const {
+    if(ValueOP::is_number(value)) {
+        Number number = ValueOP::as_number(value);
+        if(number.is_float) return otherwise;
+        
+        if(!dense.empty()) {
+            //Unsigned, so integers below low wrap around and fail the bounds check too
+            unsigned long long index = (unsigned long long)number.number.whole - (unsigned long long)low;
+            return index < dense.size() ? dense[index] : otherwise;
+        }
+        
+        auto target = integers.find(number.number.whole);
+        return target != integers.end() ? target->second : otherwise;
+    }
+    
+    if(ValueOP::is_string(value)) {
+        auto target = strings.find(ValueOP::as_string(value));
+        return target != strings.end() ? target->second : otherwise;
+    }
+    
+    return otherwise;
+}
+
+std::vector<size_t*> SwitchTable::targets() {
+    std::vector<size_t*> targets = {&otherwise};
+    for(size_t& target : dense) targets.push_back(&target);
+    for(auto& entry : integers) targets.push_back(&entry.second);
+    for(auto& entry : strings) targets.push_back(&entry.second);
+    
+    return targets;
+}
+
 int Chunk::getLine(size_t index) {
+    return (int)getLineEntry(index).line;
+}
+
+const Line& Chunk::getLineEntry(size_t index) {
     int left = 0;
     int right = (int)this->lineCount - 1;
     while(left < right - 1) {
         int mid = left + (right - left) / 2;
         
         if(this->lines[mid].start == index) {
-            return (int)this->lines[mid].line;
+            return this->lines[mid];
         } else if (this->lines[mid].start < index) {
             left = mid;
         } else {
@@ -53,7 +102,7 @@ int Chunk::getLine(size_t index) {
         }
     }
     
-    return this->lines[right].start > index ? (int)this->lines[left].line : (int)this->lines[right].line;
+    return this->lines[right].start > index ? this->lines[left] : this->lines[right];
 }
 
 void Chunk::writeConstant(Value value, int line) {
@@ -40,6 +40,7 @@ enum OpCode : uint8_t {
     OP_GET_LOCAL,
     OP_JUMP_IF_FALSE,
     OP_JUMP_IF_EMPTY,
+    OP_JUMP_IF_TRUE,
     OP_JUMP,
     OP_LOOP,
     OP_DUP,
@@ -57,13 +58,78 @@ enum OpCode : uint8_t {
     OP_INHERIT,
     OP_GET_SUPER,
     OP_SUPER_INVOKE,
-    OP_RANGE
+    OP_RANGE,
+    OP_SWITCH_TABLE,
+    OP_INLINE_GUARD,
+    OP_SLIDE,
+    OP_TAIL_CALL,
+    OP_MODULO,
+    OP_INT_DIVIDE,
+    OP_BIT_AND,
+    OP_BIT_OR,
+    OP_BIT_XOR,
+    OP_BIT_NOT,
+    OP_SHIFT_LEFT,
+    OP_SHIFT_RIGHT,
+    OP_SHIFT_RIGHT_UNSIGNED,
+    OP_BUILD_STRING,
+    
+    //Arithmetic on numbers the optimizer expects to be whole, which only overflow can turn into floats
+    OP_ADD_INT,
+    OP_SUBTRACT_INT,
+    OP_MULTIPLY_INT,
+    OP_GREATER_INT,
+    OP_LESS_INT,
+    
+    //Arithmetic on operands the optimizer proved to be numbers
+    OP_ADD_NUM,
+    OP_SUBTRACT_NUM,
+    OP_MULTIPLY_NUM,
+    OP_DIVIDE_NUM,
+    OP_GREATER_NUM,
+    OP_LESS_NUM
+};
+
+//Flags of the byte before each captured variable index following OP_CLOSURE
+enum CaptureFlag : uint8_t {
+    CAPTURE_LOCAL = 1,    //the variable is a local of the enclosing function, otherwise one of its upvalues
+    CAPTURE_BY_VALUE = 2  //the variable is never assigned, so the closure keeps a copy of it
 };
 
 //Data structure that represent a line in source code
 struct Line{
     size_t start;
     size_t line;
+    
+    //Function the code was inlined from, line is then a line of that function and callLine the line of the call
+    ObjFunction* inlinedFrom = nullptr;
+    size_t callLine = 0;
+};
+
+/// Jump table of a switch statement whose cases are all integer or string literals.
+/// Targets are offsets into the chunk of the case bodies.
+struct SwitchTable {
+    /// Integer of the first entry in dense
+    long long low;
+    
+    /// Target for each integer from low on, used when the integer cases are close together
+    std::vector<size_t> dense;
+    
+    /// Target for each integer case, used when they are too far apart for a dense table
+    std::unordered_map<long long, size_t> integers;
+    
+    /// Target for each string case. Strings are interned, so their address identifies them.
+    std::unordered_map<ObjString*, size_t> strings;
+    
+    /// Target when no case matches
+    size_t otherwise;
+    
+    /// Find the target for the value being switched on
+    /// @param value The value being switched on
+    size_t lookup(Value value) const;
+    
+    /// Every target in the table, so the optimizer can follow and relocate them
+    std::vector<size_t*> targets();
 };
 
 class Chunk {
@@ -84,6 +150,9 @@ public:
     //constants each chunk keeps
     ValueArray constants;
     
+    //jump tables of the switch statements in the chunk, indexed by OP_SWITCH_TABLE
+    std::vector<SwitchTable> switchTables;
+    
     
     /// Adds a constant to the constant vector
     /// @param value constant to be added
@@ -104,6 +173,15 @@ public:
     /// @return the line of the source code that the bytecode came from
     int getLine(size_t index);
     
+    /// Find the line table entry a bytecode belongs to, which also tells if the bytecode was inlined from another function
+    /// @param index the index of the bytecode
+    const Line& getLineEntry(size_t index);
+    
+    /// Drop the bytecode and constants past the given counts, used when the compiler replaces code it already emitted.
+    /// @param codeCount Number of bytes to keep
+    /// @param constantCount Number of constants to keep
+    void truncate(size_t codeCount, size_t constantCount);
+    
     //write a constant to the chunk and it location to the byte code
     void writeConstant(Value value, int line);
 };
@@ -1,12 +1,12 @@
 #include "compiler.hpp"
 #include "memory.hpp"
 #include "debug.hpp"
+#include "optimizer.hpp"
 #include "flags.hpp"
 #include "util.hpp"
-#include <filesystem>
 
 //Table containing precedence and compiling rules for all tokens
-ParseRule rules[53] = {
+ParseRule rules[63] = {
     [TOKEN_LEFT_PAREN]    = {&Compiler::grouping, &Compiler::call,   PREC_CALL},
     [TOKEN_RIGHT_PAREN]   = {nullptr,     nullptr,   PREC_NONE},
     [TOKEN_LEFT_BRACE]    = {nullptr,     nullptr,   PREC_NONE},
@@ -20,6 +20,12 @@ ParseRule rules[53] = {
     [TOKEN_SEMICOLON]     = {nullptr,     nullptr,   PREC_NONE},
     [TOKEN_SLASH]         = {nullptr,     &Compiler::binary, PREC_FACTOR},
     [TOKEN_STAR]          = {nullptr,     &Compiler::binary, PREC_FACTOR},
+    [TOKEN_PERCENT]       = {nullptr,     &Compiler::binary, PREC_FACTOR},
+    [TOKEN_BACKSLASH]     = {nullptr,     &Compiler::binary, PREC_FACTOR},
+    [TOKEN_AMPERSAND]     = {nullptr,     &Compiler::binary, PREC_BIT_AND},
+    [TOKEN_PIPE]          = {nullptr,     &Compiler::binary, PREC_BIT_OR},
+    [TOKEN_CARET]         = {nullptr,     &Compiler::binary, PREC_BIT_XOR},
+    [TOKEN_TILDE]         = {&Compiler::unary,     nullptr,   PREC_NONE},
     [TOKEN_BANG]          = {&Compiler::unary,     nullptr,   PREC_NONE},
     [TOKEN_BANG_EQUAL]    = {nullptr,     &Compiler::binary,   PREC_EQUALITY},
     [TOKEN_EQUAL]         = {nullptr,     nullptr,   PREC_NONE},
@@ -30,8 +36,12 @@ ParseRule rules[53] = {
     [TOKEN_LESS_EQUAL]    = {nullptr,     &Compiler::binary,   PREC_COMPARISON},
     [TOKEN_QUESTION_MARK] = {nullptr,     &Compiler::condition, PREC_CONDITIONAL},
     [TOKEN_COLON]         = {nullptr,     &Compiler::steps,   PREC_CONDITIONAL},
+    [TOKEN_LESS_LESS]     = {nullptr,     &Compiler::binary,   PREC_SHIFT},
+    [TOKEN_GREATER_GREATER] = {nullptr,   &Compiler::binary,   PREC_SHIFT},
+    [TOKEN_GREATER_GREATER_GREATER] = {nullptr, &Compiler::binary, PREC_SHIFT},
     [TOKEN_IDENTIFIER]    = {&Compiler::variable,     nullptr,   PREC_NONE},
     [TOKEN_STRING]        = {&Compiler::string, nullptr, PREC_NONE},
+    [TOKEN_INTERPOLATION] = {&Compiler::interpolation, nullptr, PREC_NONE},
     [TOKEN_NUMBER]        = {&Compiler::number, nullptr, PREC_NONE},
     [TOKEN_FLOAT]         = {&Compiler::number, nullptr, PREC_NONE},
     [TOKEN_AND]           = {nullptr,     &Compiler::_and,   PREC_AND},
@@ -69,13 +79,14 @@ ParseRule rules[53] = {
 /// @return True if the tokens are equal, false otherwise
 bool identifierEqual(Token* a, Token* b) {
     if (a->length != b->length) return false;
-    return a->source.compare(b->source) == 0;
+    return a->source == b->source;
 }
 
 Local::Local() : name(TOKEN_NUL, "", 0, 0, 0) {
     this->depth = -1;
     this->isConst = false;
     this->isCaptured = false;
+    this->isAssigned = false;
 }
 
 Compiler::Compiler(VM* vm, FunctionType type, Compiler* enclosing, Scanner* scanner, Parser* parser, const std::string& current_source) : stringConstants(vm) {
@@ -155,7 +166,7 @@ void Parser::advance() {
         this->current = scanner->scanToken();
         if (this->current.type != TOKEN_ERROR) break;
         
-        errorAtCurrent(this->current.source);
+        errorAtCurrent(std::string(this->current.source));
     }
 }
 
@@ -195,12 +206,23 @@ ObjFunction* Compiler::endCompiler() {
     emitReturn();
     ObjFunction* function = this->function;
     
+    //Locals of the function body are never popped by endScope, their captures are settled here
+    for(int i = 0; i < localCount; i++) finishCaptures(locals[i]);
+    
     vm->current = enclosing;
     
+    if(!parser->hadError) {
+        std::string name = function->name != nullptr ? function->name->chars() : "<script>";
+        
+        if(DEBUG_PRINT_PEEPHOLE) Disassembler::disassembleChunk(currentChunk(), vm, name + " before optimization");
+        Optimizer::optimize(function);
+        if(DEBUG_PRINT_PEEPHOLE) Disassembler::disassembleChunk(currentChunk(), vm, name + " after optimization");
+    }
+    
     if(DEBUG_PRINT_CODE) {
         if(!parser->hadError) {
             Disassembler::disassembleChunk(currentChunk(), vm, function->name != nullptr
-                                           ? function->name->chars : "<script>");
+                                           ? function->name->chars() : "<script>");
         }
     }
     
@@ -208,11 +230,25 @@ ObjFunction* Compiler::endCompiler() {
 }
 
 void Compiler::condition(bool canAssign) {
+    bool constantCondition = isConstantAt(operandStart);
+    ConstantExpr condition = lastConstant;
+    
+    size_t thenStart = currentChunk()->count;
     parsePrecedence(PREC_OR);
+    bool constantThen = isConstantAt(thenStart);
+    Value thenValue = lastConstant.value;
     
     parser->consume(TOKEN_COLON, "Expect ':' after conditional operator");
     
+    size_t elseStart = currentChunk()->count;
     parsePrecedence(PREC_ASSIGNMENT);
+    
+    //OP_CONDITIONAL evaluates both branches, so only fold when both are constant as well
+    if(constantCondition && ValueOP::is_bool(condition.value) && constantThen && isConstantAt(elseStart)) {
+        foldConstant(condition, ValueOP::as_bool(condition.value) ? thenValue : lastConstant.value);
+        return;
+    }
+    
     emitByte(OP_CONDITIONAL);
 }
 
@@ -231,21 +267,60 @@ void Compiler::emitBytes(uint8_t byte1, uint8_t byte2) {
 }
 
 void Compiler::number(bool canAssign) {
+    std::string_view text = parser->previous.source;
+    const char* end = text.data() + text.size();
+    
     Number num;
-    if(parser->previous.type == TOKEN_FLOAT) {
-        double value = std::stod(parser->previous.source);
-        num.is_float = true;
-        num.number.decimal = value;
-    } else {
-        long long value = std::stoll(parser->previous.source);
+    if(parser->previous.type == TOKEN_NUMBER && text.size() > 2 && text[0] == '0' && isalpha(text[1])) {
+        //Hexadecimal and binary literals spell out the bits, so they may set the sign bit
+        int base = text[1] == 'x' || text[1] == 'X' ? 16 : 2;
+        unsigned long long bits;
+        if(std::from_chars(text.data() + 2, end, bits, base).ec != std::errc()) {
+            parser->errorAtPrevious("Number literal does not fit in 64 bits.");
+            return;
+        }
+        num = Number::gen_whole_num((long long)bits);
+    } else if(parser->previous.type == TOKEN_NUMBER && std::from_chars(text.data(), end, num.number.whole).ec == std::errc()) {
         num.is_float = false;
-        num.number.whole = value;
+    } else {
+        //Whole literals too large for 64 bits become floats, like arithmetic that overflows
+        if(!Number::parseFloat(text, num.number.decimal)) {
+            parser->errorAtPrevious("Number literal is too large.");
+            return;
+        }
+        num.is_float = true;
     }
     emitConstant(ValueOP::number_val(num));
 }
 
 void Compiler::emitConstant(Value value) {
+    size_t start = currentChunk()->count;
+    size_t constantCount = currentChunk()->constants.count;
+    
     emitBytes(OP_CONSTANT, makeConstant(value));
+    lastConstant = {start, currentChunk()->count, constantCount, value};
+}
+
+bool Compiler::isConstantAt(size_t start) {
+    if(OPTIMIZATION_LEVEL == 0) return false;
+    return lastConstant.start == start && lastConstant.end == currentChunk()->count && lastConstant.end > start;
+}
+
+void Compiler::foldConstant(const ConstantExpr& first, Value value) {
+    //Every constant added since the first expression belongs to the expressions being replaced
+    currentChunk()->truncate(first.start, first.constantCount);
+    
+    size_t start = currentChunk()->count;
+    if(ValueOP::is_bool(value)) {
+        emitByte(ValueOP::as_bool(value) ? OP_TRUE : OP_FALSE);
+    } else if(ValueOP::is_nul(value)) {
+        emitByte(OP_NUL);
+    } else {
+        emitConstant(value);
+        return;
+    }
+    
+    lastConstant = {start, currentChunk()->count, first.constantCount, value};
 }
 
 uint8_t Compiler::makeConstant(Value value) {
@@ -265,9 +340,26 @@ void Compiler::grouping(bool canAssign) {
 
 void Compiler::unary(bool canAssign) {
     TokenType operatorType = parser->previous.type;
+    size_t start = currentChunk()->count;
     
     parsePrecedence(PREC_UNARY);
     
+    if(isConstantAt(start)) {
+        ConstantExpr operand = lastConstant;
+        if(operatorType == TOKEN_BANG) {
+            foldConstant(operand, ValueOP::bool_val(VM::isFalsey(operand.value)));
+            return;
+        }
+        if(operatorType == TOKEN_MINUS && ValueOP::is_number(operand.value)) {
+            foldConstant(operand, ValueOP::number_val(-ValueOP::as_number(operand.value)));
+            return;
+        }
+        if(operatorType == TOKEN_TILDE && ValueOP::is_number(operand.value) && ValueOP::is_whole_number(operand.value)) {
+            foldConstant(operand, ValueOP::number_val(~ValueOP::as_number(operand.value)));
+            return;
+        }
+    }
+    
     switch (operatorType) {
         case TOKEN_BANG:
             emitByte(OP_NOT);
@@ -275,6 +367,9 @@ void Compiler::unary(bool canAssign) {
         case TOKEN_MINUS:
             emitByte(OP_NEGATE);
             break;
+        case TOKEN_TILDE:
+            emitByte(OP_BIT_NOT);
+            break;
             
         default:
             return; //unreachable
@@ -286,12 +381,54 @@ void Compiler::string(bool canAssign) {
     emitConstant(ValueOP::obj_val(string));
 }
 
+void Compiler::interpolation(bool canAssign) {
+    int parts = 0;
+    
+    //Each segment lexeme starts with the backtick or the brace closing the previous interpolation,
+    //and ends with the ${ opening the next one or with the closing backtick
+    do {
+        std::string_view segment = parser->previous.source.substr(1, parser->previous.source.size() - 3);
+        if(!segment.empty()) {
+            emitConstant(ValueOP::obj_val(ObjString::copyString(vm, segment)));
+            parts++;
+        }
+        
+        //The segment after an empty ${} would otherwise parse as a string expression
+        if((parser->check(TOKEN_STRING) || parser->check(TOKEN_INTERPOLATION)) && parser->current.source[0] == '}') {
+            parser->errorAtCurrent("Expect expression in interpolation.");
+            return;
+        }
+        
+        expression();
+        parts++;
+    } while(match(TOKEN_INTERPOLATION));
+    
+    parser->consume(TOKEN_STRING, "Expect '}' after interpolated expression.");
+    std::string_view segment = parser->previous.source.substr(1, parser->previous.source.size() - 2);
+    if(!segment.empty()) {
+        emitConstant(ValueOP::obj_val(ObjString::copyString(vm, segment)));
+        parts++;
+    }
+    
+    if(parts > UINT8_MAX) {
+        parser->errorAtPrevious("Too many parts in an interpolated string.");
+        return;
+    }
+    
+    emitBytes(OP_BUILD_STRING, (uint8_t)parts);
+}
+
 void Compiler::binary(bool canAssign) {
     TokenType operatorType = parser->previous.type;
+    bool constantLeft = isConstantAt(operandStart);
+    ConstantExpr left = lastConstant;
+    size_t rightStart = currentChunk()->count;
     
     ParseRule* rule = ParseRule::getRule(operatorType);
     parsePrecedence((Precedence)(rule->precedence + 1));
     
+    if(constantLeft && isConstantAt(rightStart) && foldBinary(operatorType, left, lastConstant.value)) return;
+    
     switch(operatorType) {
         case TOKEN_BANG_EQUAL:
             emitBytes(OP_EQUAL, OP_NOT);
@@ -323,6 +460,30 @@ void Compiler::binary(bool canAssign) {
         case TOKEN_SLASH:
             emitByte(OP_DIVIDE);
             break;
+        case TOKEN_PERCENT:
+            emitByte(OP_MODULO);
+            break;
+        case TOKEN_BACKSLASH:
+            emitByte(OP_INT_DIVIDE);
+            break;
+        case TOKEN_AMPERSAND:
+            emitByte(OP_BIT_AND);
+            break;
+        case TOKEN_PIPE:
+            emitByte(OP_BIT_OR);
+            break;
+        case TOKEN_CARET:
+            emitByte(OP_BIT_XOR);
+            break;
+        case TOKEN_LESS_LESS:
+            emitByte(OP_SHIFT_LEFT);
+            break;
+        case TOKEN_GREATER_GREATER:
+            emitByte(OP_SHIFT_RIGHT);
+            break;
+        case TOKEN_GREATER_GREATER_GREATER:
+            emitByte(OP_SHIFT_RIGHT_UNSIGNED);
+            break;
             
         default:
             return; //unreachable
@@ -330,7 +491,103 @@ void Compiler::binary(bool canAssign) {
 }
 
 
+bool Compiler::foldBinary(TokenType operatorType, const ConstantExpr& left, Value right) {
+    Value a = left.value;
+    
+    switch(operatorType) {
+        case TOKEN_BANG_EQUAL:
+            foldConstant(left, ValueOP::bool_val(!ValueOP::valuesEqual(a, right)));
+            return true;
+        case TOKEN_EQUAL_EQUAL:
+            foldConstant(left, ValueOP::bool_val(ValueOP::valuesEqual(a, right)));
+            return true;
+        case TOKEN_PLUS:
+            //Strings are concatenated and interned exactly like OP_ADD does at runtime
+            if(ValueOP::is_string(a) && ValueOP::is_string(right)) {
+                ObjString* result = ObjString::concatenate(vm, ValueOP::as_string(a)->view(), ValueOP::as_string(right)->view())->intern(vm);
+                foldConstant(left, ValueOP::obj_val(result));
+                return true;
+            }
+            break;
+            
+        default:
+            break;
+    }
+    
+    //The rest only apply to numbers, anything else is left to raise its error at runtime
+    if(!ValueOP::is_number(a) || !ValueOP::is_number(right)) return false;
+    Number x = ValueOP::as_number(a);
+    Number y = ValueOP::as_number(right);
+    
+    switch(operatorType) {
+        case TOKEN_GREATER:
+            foldConstant(left, ValueOP::bool_val(x > y));
+            return true;
+        case TOKEN_GREATER_EQUAL:
+            foldConstant(left, ValueOP::bool_val(!(x < y)));
+            return true;
+        case TOKEN_LESS:
+            foldConstant(left, ValueOP::bool_val(x < y));
+            return true;
+        case TOKEN_LESS_EQUAL:
+            foldConstant(left, ValueOP::bool_val(!(x > y)));
+            return true;
+        case TOKEN_PLUS:
+            foldConstant(left, ValueOP::number_val(x + y));
+            return true;
+        case TOKEN_MINUS:
+            foldConstant(left, ValueOP::number_val(x - y));
+            return true;
+        case TOKEN_STAR:
+            foldConstant(left, ValueOP::number_val(x * y));
+            return true;
+        case TOKEN_SLASH:
+            foldConstant(left, ValueOP::number_val(x / y));
+            return true;
+            
+        default:
+            break;
+    }
+    
+    //Whole numbers divided by zero are left to raise their error at runtime
+    bool whole = !x.is_float && !y.is_float;
+    if(operatorType == TOKEN_PERCENT || operatorType == TOKEN_BACKSLASH) {
+        if(whole && y.number.whole == 0) return false;
+        foldConstant(left, ValueOP::number_val(operatorType == TOKEN_PERCENT ? x % y : intDivide(x, y)));
+        return true;
+    }
+    
+    bool shift = operatorType == TOKEN_LESS_LESS || operatorType == TOKEN_GREATER_GREATER ||
+                 operatorType == TOKEN_GREATER_GREATER_GREATER;
+    if(!whole || (shift && (y.number.whole < 0 || y.number.whole > 63))) return false;
+    
+    switch(operatorType) {
+        case TOKEN_AMPERSAND:
+            foldConstant(left, ValueOP::number_val(x & y));
+            return true;
+        case TOKEN_PIPE:
+            foldConstant(left, ValueOP::number_val(x | y));
+            return true;
+        case TOKEN_CARET:
+            foldConstant(left, ValueOP::number_val(x ^ y));
+            return true;
+        case TOKEN_LESS_LESS:
+            foldConstant(left, ValueOP::number_val(shiftLeft(x, y)));
+            return true;
+        case TOKEN_GREATER_GREATER:
+            foldConstant(left, ValueOP::number_val(shiftRight(x, y)));
+            return true;
+        case TOKEN_GREATER_GREATER_GREATER:
+            foldConstant(left, ValueOP::number_val(shiftRightUnsigned(x, y)));
+            return true;
+            
+        default:
+            return false;
+    }
+}
+
 void Compiler::parsePrecedence(Precedence precedence) {
+    size_t start = currentChunk()->count;
     parser->advance();
     ParseFn prefixRule = ParseRule::getRule(parser->previous.type)->prefix;
     if (prefixRule == nullptr) {
@@ -344,6 +601,7 @@ void Compiler::parsePrecedence(Precedence precedence) {
     while (precedence <= ParseRule::getRule(parser->current.type)->precedence) {
         parser->advance();
         ParseFn infixRule = ParseRule::getRule(parser->previous.type)->infix;
+        operandStart = start;
         std::invoke(infixRule, *this, canAssign);
     }
     
@@ -353,28 +611,45 @@ void Compiler::parsePrecedence(Precedence precedence) {
 }
 
 void Compiler::literal(bool canAssign) {
+    size_t start = currentChunk()->count;
+    Value value;
+    
     switch(parser->previous.type) {
         case TOKEN_FALSE:
             emitByte(OP_FALSE);
+            value = ValueOP::bool_val(false);
             break;
         case TOKEN_NUL:
             emitByte(OP_NUL);
+            value = ValueOP::nul_val();
             break;
         case TOKEN_TRUE:
             emitByte(OP_TRUE);
+            value = ValueOP::bool_val(true);
             break;
             
         default:
             return; //unreachable
     }
+    
+    lastConstant = {start, currentChunk()->count, currentChunk()->constants.count, value};
 }
 
 void Compiler::expression() {
     parsePrecedence(PREC_ASSIGNMENT);
 }
 
-ObjFunction* Compiler::compile(const std::string& src) {
-    scanner->setSource(src);
+ObjFunction* Compiler::compile(std::string src) {
+    scanner->setSource(std::move(src));
+    if(type == TYPE_SCRIPT) vm->modules.preload(current_source, scanner);
+    
+    ObjFunction* function = compile();
+    if(function != nullptr) Optimizer::optimizeProgram(function);
+    return function;
+}
+
+ObjFunction* Compiler::compile() {
+    scanner->rewind();
     
     parser->hadError = false;
     parser->panicMode = false;
@@ -574,6 +849,12 @@ void Compiler::namedVariable(Token* name, bool canAssign) {
         
         expression();
         emitBytes(setOp, arg);
+        
+        if(setOp == OP_SET_LOCAL) {
+            locals[arg].isAssigned = true;
+        } else if(setOp == OP_SET_UPVALUE) {
+            markUpvalueAssigned(arg);
+        }
     } else {
         emitBytes(getOp, arg);
     }
@@ -595,7 +876,7 @@ void Compiler::endScope() {
     scopeDepth--;
     
     while (localCount > 0 && locals[localCount - 1].depth > scopeDepth) {
-        if (locals[localCount - 1].isCaptured) {
+        if (finishCaptures(locals[localCount - 1])) {
             emitByte(OP_CLOSE_UPVALUE);
         } else {
             emitByte(OP_POP);
@@ -635,6 +916,9 @@ void Compiler::addLocal(Token name, bool isConst) {
     Local* local = &locals[localCount++];
     local->name = name;
     local->isConst = isConst;
+    local->isCaptured = false;
+    local->isAssigned = false;
+    local->captures.clear();
 }
 
 int Compiler::resolveLocal(Token* name) {
@@ -692,7 +976,7 @@ void Compiler::patchJump(size_t offset) {
 }
 
 void Compiler::patchBreaks() {
-    for(int i = (int)breakStatements.size() - 1; i >= 0 && breakStatements[i].depth >= innermostLoopScopeDepth; i--) {
+    for(int i = (int)breakStatements.size() - 1; i >= 0 && breakStatements[i].depth >= innermostBreakScopeDepth; i--) {
         patchJump(breakStatements[i].position);
         breakStatements.pop_back();
     }
@@ -721,8 +1005,10 @@ void Compiler::_or(bool canAssign) {
 void Compiler::whileStatement() {
     int surroundingLoopStart = innermostLoopStart;
     int surroundingLoopScopeDepth = innermostLoopScopeDepth;
+    int surroundingBreakScopeDepth = innermostBreakScopeDepth;
     innermostLoopStart = (int)currentChunk()->count;
     innermostLoopScopeDepth = scopeDepth;
+    innermostBreakScopeDepth = scopeDepth;
     
     parser->consume(TOKEN_LEFT_PAREN, "Expect '(' after 'while'.");
     expression();
@@ -742,6 +1028,7 @@ void Compiler::whileStatement() {
     
     innermostLoopStart = surroundingLoopStart;
     innermostLoopScopeDepth = surroundingLoopScopeDepth;
+    innermostBreakScopeDepth = surroundingBreakScopeDepth;
 }
 
 void Compiler::emitLoop(int loopStart) {
@@ -769,8 +1056,10 @@ void Compiler::forStatement() {
     
     int surroundingLoopStart = innermostLoopStart;
     int surroundingLoopScopeDepth = innermostLoopScopeDepth;
+    int surroundingBreakScopeDepth = innermostBreakScopeDepth;
     innermostLoopStart = (int)currentChunk()->count;
     innermostLoopScopeDepth = scopeDepth;
+    innermostBreakScopeDepth = scopeDepth;
     
     int exitJump = -1;
     if(!match(TOKEN_SEMICOLON)) {
@@ -808,18 +1097,21 @@ void Compiler::forStatement() {
     
     innermostLoopStart = surroundingLoopStart;
     innermostLoopScopeDepth = surroundingLoopScopeDepth;
+    innermostBreakScopeDepth = surroundingBreakScopeDepth;
     
     endScope();
 }
 
 
 void Compiler::continueStatement() {
-    if (innermostLoopScopeDepth == -1) {
+    if (innermostLoopStart == -1) {
         parser->errorAtPrevious("Cannot use 'continue' outside of a loop.");
     }
     
     parser->consume(TOKEN_SEMICOLON, "Expect ';' after 'continue'.");
     
+    //Also pops the value and the locals of any switch the continue is in, a switch is not a loop
+
     for (int i = localCount - 1; i >= 0 && locals[i].depth > innermostLoopScopeDepth; i--) {
         emitByte(OP_POP);
     }
@@ -828,17 +1120,17 @@ void Compiler::continueStatement() {
 }
 
 void Compiler::breakStatement() {
-    if (innermostLoopScopeDepth == -1) {
-        parser->errorAtPrevious("Cannot use 'break' outside of a loop");
+    if (innermostBreakScopeDepth == -1) {
+        parser->errorAtPrevious("Cannot use 'break' outside of a loop or switch.");
     }
     
     parser->consume(TOKEN_SEMICOLON, "Expect ';' after 'break'.");
     
-    for (int i = localCount - 1; i >= 0 && locals[i].depth > innermostLoopScopeDepth; i--) {
+    for (int i = localCount - 1; i >= 0 && locals[i].depth > innermostBreakScopeDepth; i--) {
         emitByte(OP_POP);
     }
     
-    breakStatements.push_back(Break{emitJump(OP_JUMP),innermostLoopScopeDepth});
+    breakStatements.push_back(Break{emitJump(OP_JUMP),innermostBreakScopeDepth});
 }
 
 
@@ -853,11 +1145,19 @@ void Compiler::switchStatement() {
     parser->consume(TOKEN_RIGHT_PAREN, "Expect ')' after value.");
     parser->consume(TOKEN_LEFT_BRACE, "Exprect '{' before cases.");
     
+    //The value switched on stays in a slot of its own, so locals declared in the cases get the slots after it
     beginScope();
-    int surroundingLoopStart = innermostLoopStart;
-    int surroundingLoopScopeDepth = innermostLoopScopeDepth;
-    innermostLoopStart = (int)currentChunk()->count;
-    innermostLoopScopeDepth = scopeDepth;
+    addLocal(Token::createToken("switch"), true);
+    defineVariable(0);
+    
+    //A switch is only a target for break, continue still goes to the enclosing loop
+    int surroundingBreakScopeDepth = innermostBreakScopeDepth;
+    innermostBreakScopeDepth = scopeDepth;
+    
+    size_t table = emitJump(OP_SWITCH_TABLE);
+    std::vector<SwitchCase> cases;
+    bool literalCases = true;
+    size_t otherwise = 0;
     
     int state = BEFORE_CASES;
     int previousCaseSkip = -1;
@@ -889,7 +1189,13 @@ void Compiler::switchStatement() {
                 state = BEFORE_DEFAULT;
                 
                 emitByte(OP_DUP);
-                expression();
+                
+                //Parsed above the conditional operator, whose ':' would swallow the one ending the case
+                size_t valueStart = currentChunk()->count;
+                parsePrecedence(PREC_OR);
+                Value value = lastConstant.value;
+                literalCases = literalCases && isConstantAt(valueStart) &&
+                    (ValueOP::is_string(value) || (ValueOP::is_number(value) && !ValueOP::as_number(value).is_float));
                 
                 parser->consume(TOKEN_COLON, "Expect ':' after case value.");
                 
@@ -897,11 +1203,13 @@ void Compiler::switchStatement() {
                 previousCaseSkip = (int)emitJump(OP_JUMP_IF_FALSE);
                 
                 emitByte(OP_POP);
+                cases.push_back(SwitchCase{value, currentChunk()->count});
                 
             } else {
                 state = 2;
                 parser->consume(TOKEN_COLON, "Expect ':' after default.");
                 previousCaseSkip = -1;
+                otherwise = currentChunk()->count;
             }
         } else {
             if(state == 0) {
@@ -911,22 +1219,65 @@ void Compiler::switchStatement() {
         }
     }
     
-    patchBreaks();
+    //The last case runs past the pop of its failed test, breaks land after it as well
     if(state == 1) {
+        size_t lastCaseEnds = emitJump(OP_JUMP);
         patchJump(previousCaseSkip);
         emitByte(OP_POP);
+        patchJump(lastCaseEnds);
     }
+    patchBreaks();
     
-    emitByte(OP_POP);
+    if(state != 2) otherwise = currentChunk()->count;
+    emitSwitchTable(table, literalCases ? cases : std::vector<SwitchCase>(), otherwise);
     
-    innermostLoopStart = surroundingLoopStart;
-    innermostLoopScopeDepth = surroundingLoopScopeDepth;
+    innermostBreakScopeDepth = surroundingBreakScopeDepth;
     endScope();
 #undef BEFORE_CASES
 #undef BEFORE_DEFAULT
 #undef AFTER_DEFAULT
 }
 
+void Compiler::emitSwitchTable(size_t placeholder, const std::vector<SwitchCase>& cases, size_t otherwise) {
+    Chunk* chunk = currentChunk();
+    SwitchTable table = {0, {}, {}, {}, otherwise};
+    
+    bool usable = !cases.empty() && chunk->switchTables.size() <= UINT16_MAX;
+    long long low = LLONG_MAX;
+    long long high = LLONG_MIN;
+    for(const SwitchCase& c : cases) {
+        if(ValueOP::is_string(c.value)) {
+            //A repeated case is only reached by falling through the earlier one, which the table cannot express
+            usable = usable && table.strings.emplace(ValueOP::as_string(c.value), c.body).second;
+        } else {
+            long long whole = ValueOP::as_number(c.value).number.whole;
+            usable = usable && table.integers.emplace(whole, c.body).second;
+            low = std::min(low, whole);
+            high = std::max(high, whole);
+        }
+    }
+    
+    if(!usable) {
+        chunk->code[placeholder - 1] = OP_JUMP;
+        chunk->code[placeholder] = 0;
+        chunk->code[placeholder + 1] = 0;
+        return;
+    }
+    
+    //Integers close together index an array directly, holes go to the default case
+    if(!table.integers.empty() && (unsigned long long)(high - low) < 4 * table.integers.size()) {
+        table.low = low;
+        table.dense.assign(high - low + 1, otherwise);
+        for(const auto& entry : table.integers) table.dense[entry.first - low] = entry.second;
+        table.integers.clear();
+    }
+    
+    size_t index = chunk->switchTables.size();
+    chunk->switchTables.push_back(std::move(table));
+    chunk->code[placeholder] = (index >> 8) & 0xff;
+    chunk->code[placeholder + 1] = index & 0xff;
+}
+
 void Compiler::funDeclaration() {
     uint8_t global = parseVariable("Expect function name", false, true);
     markInitialized();
@@ -981,7 +1332,8 @@ void Compiler::_function(FunctionType type) {
         emitBytes(OP_CLOSURE, functionConstant);
         
         for(int i = 0; i < function->upvalueCount; i++) {
-            emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+            if(compiler.upvalues[i].isLocal) locals[compiler.upvalues[i].index].captures.push_back(currentChunk()->count);
+            emitByte(compiler.upvalues[i].isLocal ? CAPTURE_LOCAL : 0);
             emitByte(compiler.upvalues[i].index);
         }
     } else {
@@ -991,6 +1343,7 @@ void Compiler::_function(FunctionType type) {
 
 void Compiler::call(bool canAssign) {
     uint8_t argCount = argumentList();
+    lastCall = currentChunk()->count;
     emitBytes(OP_CALL, argCount);
 }
 
@@ -1024,6 +1377,11 @@ void Compiler::returnStatement() {
         }
         expression();
         parser->consume(TOKEN_SEMICOLON, "Expect ';' after return.");
+        
+        //A call that is the whole returned expression reuses the frame of this function
+        if(lastCall + 2 == currentChunk()->count && type != TYPE_SCRIPT && type != TYPE_IMPORT && type != TYPE_INITIALIZER) {
+            currentChunk()->code[lastCall] = OP_TAIL_CALL;
+        }
         emitByte(OP_RETURN);
     }
 }
@@ -1045,6 +1403,23 @@ int Compiler::resolveUpvalue(Token *name) {
     return -1;
 }
 
+void Compiler::markUpvalueAssigned(int upvalue) {
+    if(upvalues[upvalue].isLocal) {
+        enclosing->locals[upvalues[upvalue].index].isAssigned = true;
+    } else {
+        enclosing->markUpvalueAssigned(upvalues[upvalue].index);
+    }
+}
+
+bool Compiler::finishCaptures(Local& local) {
+    if(!local.isCaptured) return false;
+    if(local.isAssigned || OPTIMIZATION_LEVEL == 0) return true;
+    
+    //Every closure sees the value the variable had when it was created, so nothing needs to be shared
+    for(size_t position : local.captures) currentChunk()->code[position] |= CAPTURE_BY_VALUE;
+    return false;
+}
+
 int Compiler::addUpvalue(uint8_t index, bool isLocal) {
     int upvalueCount = function->upvalueCount;
     
@@ -1208,7 +1583,21 @@ void Compiler::super(bool canAssign) {
 }
 
 void Compiler::randomAccess(bool canAssign) {
-    parsePrecedence(PREC_CALL);
+    //a[start:end] slices, leaving out a bound passes nul
+    if(parser->check(TOKEN_COLON)) emitByte(OP_NUL);
+    else parsePrecedence(PREC_OR);
+    
+    if(match(TOKEN_COLON)) {
+        if(parser->check(TOKEN_RIGHT_BRACK)) emitByte(OP_NUL);
+        else parsePrecedence(PREC_OR);
+        
+        parser->consume(TOKEN_RIGHT_BRACK, "Expect ']' after slice.");
+        Token name = Token::createToken("slice");
+        emitBytes(OP_INVOKE, addIdentifierConstant(&name));
+        emitByte(2);
+        return;
+    }
+    
     parser->consume(TOKEN_RIGHT_BRACK, "Expect ']' after expression.");
     if(parser->check(TOKEN_EQUAL)) {
         parser->advance();
@@ -1239,12 +1628,7 @@ void Compiler::steps(bool canAssign) {
 void Compiler::importStatement() {
     parser->consume(TOKEN_STRING, "Expect module name after import statement");
     
-    size_t path_index = current_source.rfind("/");
-    std::filesystem::path module_option = current_source.substr(0, path_index == std::string::npos ? 0 : path_index + 1) + parser->previous.source.substr(1, parser->previous.source.size() - 2);
-    
-    module_option += ".lox";
-    std::filesystem::path module_absolute = std::filesystem::absolute(module_option);
-    std::string module_string = module_absolute.string();
+    std::string module_string = ModuleLoader::resolvePath(current_source, std::string(parser->previous.source.substr(1, parser->previous.source.size() - 2)));
     
     parser->consume(TOKEN_SEMICOLON, "Expect ; after import statement");
     
@@ -1254,21 +1638,21 @@ void Compiler::importStatement() {
     imported_module.insert(module_string);
     
     
-    std::string import = "";
+    Scanner scanner;
+    Scanner* moduleScanner = &scanner;
     try {
-        import = readFile(module_string.c_str());
+        moduleScanner = vm->modules.scanner(module_string);
     } catch(std::string e) {
         parser->errorAtPrevious(e);
     }
     
-    Scanner scanner;
-    Parser parser(&scanner);
+    Parser parser(moduleScanner);
     
-    Compiler importScript(this->vm, TYPE_IMPORT, this, &scanner, &parser, module_string);
+    Compiler importScript(this->vm, TYPE_IMPORT, this, moduleScanner, &parser, module_string);
     importScript.compiled_source.insert(current_source);
     importScript.compiled_source.insert(compiled_source.begin(), compiled_source.end());
     
-    ObjFunction* importedFunction = importScript.compile(import);
+    ObjFunction* importedFunction = importScript.compile();
     
     imported_module.insert(importScript.imported_module.begin(), importScript.imported_module.end());
     
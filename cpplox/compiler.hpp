@@ -58,11 +58,15 @@ enum Precedence {
     PREC_CONDITIONAL,// ?:
     PREC_OR,         // or
     PREC_AND,        // and
+    PREC_BIT_OR,     // |
+    PREC_BIT_XOR,    // ^
+    PREC_BIT_AND,    // &
     PREC_EQUALITY,   // == !=
     PREC_COMPARISON, // < > <= >=
+    PREC_SHIFT,      // << >> >>>
     PREC_TERM,       // + -
-    PREC_FACTOR,     // * /
-    PREC_UNARY,      // ! -
+    PREC_FACTOR,     // * / \ %
+    PREC_UNARY,      // ! - ~
     PREC_CALL,       // .()
     PREC_PRIMARY
 };
@@ -76,6 +80,12 @@ struct Local {
     bool isConst;
     bool isCaptured;
     
+    /// Whether the variable is assigned anywhere after its declaration, including from closures
+    bool isAssigned;
+    
+    /// Positions of the capture flags of the OP_CLOSURE instructions that capture the variable
+    std::vector<size_t> captures;
+    
     /// Constructor for local variables, makes an unnamed local variable on the stack
     Local();
 };
@@ -88,6 +98,14 @@ struct Break {
     int depth;
 };
 
+/// Struct to indicate a literal case of a switch statement
+struct SwitchCase {
+    /// The integer or string the case matches
+    Value value;
+    /// Position of the case body
+    size_t body;
+};
+
 /// Struct for keeping track of Upvalues.
 struct Upvalue {
     /// Position of the upvalue in the stack
@@ -97,6 +115,18 @@ struct Upvalue {
 };
 
 
+/// Struct for keeping track of the last constant expression emitted, so that operators applied to it can be folded at compile time.
+struct ConstantExpr {
+    /// Position of the first byte of the expression
+    size_t start;
+    /// Position just past the last byte of the expression
+    size_t end;
+    /// Size of the constant table before the expression was emitted
+    size_t constantCount;
+    /// Value the expression evaluates to
+    Value value;
+};
+
 /// Class representing a compiler. Compiles functions (including base script) into chunks of byte code
 class Compiler {
     Scanner* scanner;
@@ -129,6 +159,17 @@ class Compiler {
     int innermostLoopStart = -1;
     /// The depth of inner most loop, use to detect whther or not current loop exists
     int innermostLoopScopeDepth = 0;
+    /// The depth of the inner most loop or switch, which is what a break leaves. -1 when there is none
+    int innermostBreakScopeDepth = -1;
+    
+    /// The last constant expression emitted. Only usable while nothing has been emitted after it, see isConstantAt.
+    ConstantExpr lastConstant = {0, 0, 0, ValueOP::nul_val()};
+    
+    /// Position in the chunk where the left operand of the infix rule being parsed starts
+    size_t operandStart = 0;
+    
+    /// Position in the chunk of the last OP_CALL emitted, so a return can turn it into a tail call
+    size_t lastCall = SIZE_MAX;
     
     
     /// Appending a single byte to the current chunk
@@ -139,6 +180,16 @@ class Compiler {
     /// @param value constant to be appended
     void emitConstant(Value value);
     
+    /// Check if the code from start to the end of the chunk is a single constant expression, which is then held in lastConstant.
+    /// @param start Position where the expression starts
+    bool isConstantAt(size_t start);
+    
+    /// Replace the constant expressions from the given one to the end of the chunk with a single constant.
+    /// Booleans and nul are emitted with their own instructions, other values with OP_CONSTANT.
+    /// @param first First constant expression being replaced
+    /// @param value Value of the folded expression
+    void foldConstant(const ConstantExpr& first, Value value);
+    
     /// return the current chunk to be writen
     /// @return return the current chunk
     Chunk* currentChunk();
@@ -300,6 +351,13 @@ class Compiler {
     /// Parse and compile a switch statement
     void switchStatement();
     
+    /// Fill in the OP_SWITCH_TABLE placed at the top of a switch statement. It becomes a no-op jump when the cases
+    /// cannot be dispatched through a table, in which case the case tests run one after another.
+    /// @param placeholder Position of the operand of OP_SWITCH_TABLE
+    /// @param cases The literal cases, or none if some case is not a literal
+    /// @param otherwise Position to go to when no case matches
+    void emitSwitchTable(size_t placeholder, const std::vector<SwitchCase>& cases, size_t otherwise);
+    
     /// Parse and compile a function declaration
     void funDeclaration();
     
@@ -340,6 +398,16 @@ class Compiler {
     /// @return The index of the inserted or found value in the upvalue list.
     int addUpvalue(uint8_t index, bool isLocal);
     
+    /// Record an assignment through an upvalue on the local it ultimately refers to in an enclosing function.
+    /// @param upvalue Index of the upvalue in the upvalue list.
+    void markUpvalueAssigned(int upvalue);
+    
+    /// Called when a local goes out of scope, once every assignment to it has been compiled.
+    /// If the local is never assigned, the closures that captured it copy it instead of sharing it through an upvalue.
+    /// @param local The local going out of scope.
+    /// @return Whether or not closures share the local, in which case its upvalue must be closed.
+    bool finishCaptures(Local& local);
+    
     /// Parse and compile a class declaration.
     /// This method will compile the class body and add the super class is necessary.
     void classDeclaration();
@@ -381,6 +449,14 @@ public:
     /// @param canAssign Not used
     void binary(bool canAssign);
     
+    /// Fold a binary operator applied to two constant expressions into a single constant.
+    /// Follows the runtime semantics exactly, and leaves operands that would raise a runtime error alone.
+    /// @param operatorType Operator of the binary expression
+    /// @param left Left constant expression, followed in the chunk by the right one
+    /// @param right Value of the right constant expression
+    /// @return Whether or not the expression was folded
+    bool foldBinary(TokenType operatorType, const ConstantExpr& left, Value right);
+    
     /// Parse a conditional statement (? and :)
     /// @param canAssign Not used
     void condition(bool canAssign);
@@ -394,6 +470,11 @@ public:
     /// @param canAssign Not used
     void string(bool canAssign);
     
+    /// Parse and compile a template string with interpolated expressions, starting at its first segment.
+    /// Pushes the non-empty literal segments and the expressions in order, and joins them with a single OP_BUILD_STRING.
+    /// @param canAssign Not used
+    void interpolation(bool canAssign);
+    
     /// Parse and compile a identifier. Essentially calls namedVariable on the previous token.
     /// @param canAssign Passed to namedVariable
     void variable(bool canAssign);
@@ -448,7 +529,11 @@ public:
     
     /// Compile a given source code and return an ObjFunction pointer containing the compiled function. Note that the compiled function is the "<script>"  as this method is only called by the VM.
     /// @param src Source code to be compiled
-    ObjFunction* compile(const std::string& src);
+    ObjFunction* compile(std::string src);
+    
+    /// Compile the source the scanner already holds from its beginning and return the compiled function.
+    /// Used for imported modules, which the module loader has already scanned.
+    ObjFunction* compile();
 };
 
 using ParseFn = void (Compiler::*)(bool canAssign);
@@ -50,6 +50,34 @@ int Disassembler::jumpInstruction(const std::string& name, int sign, Chunk *chun
     return offset + 3;
 }
 
+int Disassembler::inlineGuardInstruction(Chunk *chunk, int offset) {
+    uint8_t argCount = chunk->code[offset + 1];
+    uint8_t constant = chunk->code[offset + 2];
+    uint16_t jump = (uint16_t)(chunk->code[offset + 3] << 8);
+    jump |= chunk->code[offset + 4];
+    
+    std::cout << std::left << std::setw(16) << "OP_INLINE_GUARD" << " (" << (int)argCount << " args) " << std::right
+    << std::setw(4) << (int)constant << " '";
+    ValueOP::printValue(chunk->constants.values[constant]);
+    std::cout << "' -> " << offset + 5 + jump << std::endl;
+    return offset + 5;
+}
+
+int Disassembler::switchTableInstruction(Chunk *chunk, int offset) {
+    uint16_t index = (uint16_t)(chunk->code[offset + 1] << 8);
+    index |= chunk->code[offset + 2];
+    const SwitchTable& table = chunk->switchTables[index];
+    
+    std::cout << std::left << std::setw(16) << "OP_SWITCH_TABLE" << " " << std::right << std::setw(4) << index << " ";
+    if(!table.dense.empty()) {
+        std::cout << " dense " << table.low << ".." << table.low + (long long)table.dense.size() - 1;
+    } else {
+        std::cout << " " << table.integers.size() + table.strings.size() << " cases";
+    }
+    std::cout << " else -> " << table.otherwise << std::endl;
+    return offset + 3;
+}
+
 int Disassembler::invokeInstruction(const std::string &name,Chunk *chunk, int offset) {
     uint8_t constant = chunk->code[offset + 1];
     uint8_t argCount = chunk->code[offset + 2];
@@ -86,6 +114,24 @@ int Disassembler::disassembleInstruction(Chunk* chunk, VM* vm, int offset) {
             return simpleInstruction("OP_DIVIDE", offset);
         case OP_MULTIPLY:
             return simpleInstruction("OP_MULTIPLY", offset);
+        case OP_MODULO:
+            return simpleInstruction("OP_MODULO", offset);
+        case OP_INT_DIVIDE:
+            return simpleInstruction("OP_INT_DIVIDE", offset);
+        case OP_BIT_AND:
+            return simpleInstruction("OP_BIT_AND", offset);
+        case OP_BIT_OR:
+            return simpleInstruction("OP_BIT_OR", offset);
+        case OP_BIT_XOR:
+            return simpleInstruction("OP_BIT_XOR", offset);
+        case OP_BIT_NOT:
+            return simpleInstruction("OP_BIT_NOT", offset);
+        case OP_SHIFT_LEFT:
+            return simpleInstruction("OP_SHIFT_LEFT", offset);
+        case OP_SHIFT_RIGHT:
+            return simpleInstruction("OP_SHIFT_RIGHT", offset);
+        case OP_SHIFT_RIGHT_UNSIGNED:
+            return simpleInstruction("OP_SHIFT_RIGHT_UNSIGNED", offset);
         case OP_SUBTRACT:
             return simpleInstruction("OP_SUBTRACT", offset);
         case OP_NEGATE:
@@ -130,10 +176,44 @@ int Disassembler::disassembleInstruction(Chunk* chunk, VM* vm, int offset) {
             return jumpInstruction("OP_JUMP", 1, chunk, offset);
         case OP_JUMP_IF_FALSE:
             return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
+        case OP_JUMP_IF_TRUE:
+            return jumpInstruction("OP_JUMP_IF_TRUE", 1, chunk, offset);
         case OP_JUMP_IF_EMPTY:
             return jumpInstruction("OP_JUMP_IF_EMPTY", 1, chunk, offset);
         case OP_LOOP:
             return jumpInstruction("OP_LOOP", -1, chunk, offset);
+        case OP_SWITCH_TABLE:
+            return switchTableInstruction(chunk, offset);
+        case OP_INLINE_GUARD:
+            return inlineGuardInstruction(chunk, offset);
+        case OP_SLIDE:
+            return byteInstruction("OP_SLIDE", chunk, offset);
+        case OP_TAIL_CALL:
+            return byteInstruction("OP_TAIL_CALL", chunk, offset);
+        case OP_BUILD_STRING:
+            return byteInstruction("OP_BUILD_STRING", chunk, offset);
+        case OP_ADD_INT:
+            return simpleInstruction("OP_ADD_INT", offset);
+        case OP_SUBTRACT_INT:
+            return simpleInstruction("OP_SUBTRACT_INT", offset);
+        case OP_MULTIPLY_INT:
+            return simpleInstruction("OP_MULTIPLY_INT", offset);
+        case OP_GREATER_INT:
+            return simpleInstruction("OP_GREATER_INT", offset);
+        case OP_LESS_INT:
+            return simpleInstruction("OP_LESS_INT", offset);
+        case OP_ADD_NUM:
+            return simpleInstruction("OP_ADD_NUM", offset);
+        case OP_SUBTRACT_NUM:
+            return simpleInstruction("OP_SUBTRACT_NUM", offset);
+        case OP_MULTIPLY_NUM:
+            return simpleInstruction("OP_MULTIPLY_NUM", offset);
+        case OP_DIVIDE_NUM:
+            return simpleInstruction("OP_DIVIDE_NUM", offset);
+        case OP_GREATER_NUM:
+            return simpleInstruction("OP_GREATER_NUM", offset);
+        case OP_LESS_NUM:
+            return simpleInstruction("OP_LESS_NUM", offset);
         case OP_DUP:
             return simpleInstruction("OP_DUP", offset);
         case OP_CALL:
@@ -144,20 +224,21 @@ int Disassembler::disassembleInstruction(Chunk* chunk, VM* vm, int offset) {
             return byteInstruction("OP_SET_UPVALUE", chunk, offset);
         case OP_CLOSURE: {
             offset++;
-            uint8_t constant = chunk->code[offset];
-            std::cout << std::left << std::setw(16) << "OP_CLOSURE" << std::right << std::setw(4) << constant << " ";
+            uint8_t constant = chunk->code[offset++];
+            std::cout << std::left << std::setw(16) << "OP_CLOSURE" << std::right << std::setw(4) << (int)constant << " ";
             ValueOP::printValue(chunk->constants.values[constant]);
             std::cout << std::endl;
             
             ObjFunction* function = ValueOP::as_function(
                                                        chunk->constants.values[constant]);
             for(int j = 0; j < function->upvalueCount; j++) {
-                int isLocal = chunk->code[offset++];
+                int flags = chunk->code[offset++];
                 int index = chunk->code[offset++];
                 std::cout << std::right << std::setw(4) << offset - 2;
-                std::cout << "    |                     " << (isLocal ? "local" : "upvalue") << " " << index << std::endl;
+                std::cout << "    |                     " << (flags & CAPTURE_LOCAL ? "local" : "upvalue") << " " << index
+                << (flags & CAPTURE_BY_VALUE ? " (copy)" : "") << std::endl;
             }
-            return offset + 1;
+            return offset;
         }
         case OP_CLOSE_UPVALUE:
             return simpleInstruction("OP_CLOSE_UPVALUE", offset);
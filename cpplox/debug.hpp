@@ -33,6 +33,10 @@ class Disassembler {
     
     static int jumpInstruction(const std::string& name, int sign, Chunk* chunk, int offset);
     
+    static int switchTableInstruction(Chunk* chunk, int offset);
+    
+    static int inlineGuardInstruction(Chunk* chunk, int offset);
+    
     static int invokeInstruction(const std::string& name, Chunk* chunk, int offset);
     
 public:
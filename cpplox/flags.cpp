@@ -1,7 +1,9 @@
 #include "flags.hpp"
 
 bool DEBUG_PRINT_CODE = false;
+bool DEBUG_PRINT_PEEPHOLE = false;
 bool DEBUG_TRACE_EXECUTION = false;
 bool DEBUG_STRESS_GC = false;
 bool DEBUG_LOG_GC = false;
+int OPTIMIZATION_LEVEL = 1;
 std::string EXECUTION_PATH = "";
@@ -4,14 +4,20 @@
 #include <string>
 
 extern bool DEBUG_PRINT_CODE;
+extern bool DEBUG_PRINT_PEEPHOLE;
 extern bool DEBUG_TRACE_EXECUTION;
 extern bool DEBUG_STRESS_GC;
 extern bool DEBUG_LOG_GC;
+extern int OPTIMIZATION_LEVEL;
 extern std::string EXECUTION_PATH;
 //#define NAN_BOXING
 
 #define MAX_CASES 256
+#define MAX_INLINE_SIZE 32
 #define GC_HEAP_GROW_FACTOR 2
+#define ROPE_MIN_LENGTH 64
+#define SLICE_RETAIN_LIMIT 1024
+#define OUTPUT_BUFFER_SIZE 65536
 #include <cstdlib>
 
 #endif /* flags_h */
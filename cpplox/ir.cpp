@@ -0,0 +1,347 @@
+#include "ir.hpp"
+
+#ifdef NAN_BOXING
+#include "nanvalue.hpp"
+#else
+#include "value.hpp"
+#endif
+#include "object.hpp"
+
+size_t Instruction::length() const {
+    return 1 + operands.size() + (FunctionIR::isJump(op) ? 2 : 0);
+}
+
+/// Return the number of operand bytes of the instruction at the given offset.
+static size_t operandCount(Chunk* chunk, size_t offset) {
+    switch(chunk->code[offset]) {
+        case OP_CONSTANT:
+        case OP_DEFINE_GLOBAL:
+        case OP_GET_GLOBAL:
+        case OP_SET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_SET_LOCAL:
+        case OP_CALL:
+        case OP_TAIL_CALL:
+        case OP_GET_UPVALUE:
+        case OP_SET_UPVALUE:
+        case OP_CLASS:
+        case OP_SET_PROPERTY:
+        case OP_GET_PROPERTY:
+        case OP_DEL:
+        case OP_METHOD:
+        case OP_GET_SUPER:
+        case OP_SLIDE:
+        case OP_BUILD_STRING:
+            return 1;
+        case OP_INLINE_GUARD:
+            return 4;
+        case OP_JUMP:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_JUMP_IF_EMPTY:
+        case OP_LOOP:
+        case OP_SWITCH_TABLE:
+        case OP_INVOKE:
+        case OP_SUPER_INVOKE:
+            return 2;
+        case OP_CONSTANT_LONG:
+            return 4;
+        case OP_CLOSURE: {
+            //Each captured upvalue is described by two extra bytes
+            ObjFunction* function = ValueOP::as_function(chunk->constants.values[chunk->code[offset + 1]]);
+            return 1 + 2 * function->upvalueCount;
+        }
+        
+        default:
+            return 0;
+    }
+}
+
+FunctionIR::FunctionIR(Chunk* chunk) {
+    this->chunk = chunk;
+    
+    size_t lineIndex = 0;
+    for(size_t offset = 0; offset < chunk->count;) {
+        while(lineIndex + 1 < chunk->lineCount && chunk->lines[lineIndex + 1].start <= offset) lineIndex++;
+        
+        const Line& line = chunk->lines[lineIndex];
+        Instruction instruction = {offset, chunk->code[offset], {}, 0, line.line, false, line.inlinedFrom, line.callLine};
+        size_t count = operandCount(chunk, offset);
+        
+        if(isJump(instruction.op)) {
+            //The jump offset is the last two operand bytes and counts from the end of the instruction
+            size_t end = offset + 1 + count;
+            size_t jump = (size_t)(chunk->code[end - 2] << 8 | chunk->code[end - 1]);
+            instruction.target = instruction.op == OP_LOOP ? end - jump : end + jump;
+            instruction.operands.assign(chunk->code.begin() + offset + 1, chunk->code.begin() + end - 2);
+        } else {
+            instruction.operands.assign(chunk->code.begin() + offset + 1, chunk->code.begin() + offset + 1 + count);
+        }
+        
+        indexOf[offset] = instructions.size();
+        instructions.push_back(std::move(instruction));
+        offset += 1 + count;
+    }
+    
+    buildBlocks();
+}
+
+bool FunctionIR::isJump(uint8_t op) {
+    return op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_JUMP_IF_TRUE || op == OP_JUMP_IF_EMPTY || op == OP_LOOP ||
+        op == OP_INLINE_GUARD;
+}
+
+bool FunctionIR::stackEffect(const Instruction& instruction, int& pops, int& pushes) {
+    pops = 0;
+    pushes = 0;
+    
+    switch(instruction.op) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NUL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_GLOBAL:
+        case OP_GET_LOCAL:
+        case OP_GET_UPVALUE:
+        case OP_CLASS:
+        case OP_CLOSURE:
+            pushes = 1;
+            return true;
+        case OP_DUP:
+            pops = 1;
+            pushes = 2;
+            return true;
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_BIT_NOT:
+        case OP_GET_PROPERTY:
+        case OP_SET_GLOBAL:
+        case OP_SET_LOCAL:
+        case OP_SET_UPVALUE:
+        case OP_JUMP_IF_FALSE:
+        case OP_JUMP_IF_TRUE:
+        case OP_JUMP_IF_EMPTY:
+        case OP_SWITCH_TABLE:
+            pops = 1;
+            pushes = 1;
+            return true;
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+        case OP_MODULO:
+        case OP_INT_DIVIDE:
+        case OP_BIT_AND:
+        case OP_BIT_OR:
+        case OP_BIT_XOR:
+        case OP_SHIFT_LEFT:
+        case OP_SHIFT_RIGHT:
+        case OP_SHIFT_RIGHT_UNSIGNED:
+        case OP_ADD_INT:
+        case OP_SUBTRACT_INT:
+        case OP_MULTIPLY_INT:
+        case OP_GREATER_INT:
+        case OP_LESS_INT:
+        case OP_ADD_NUM:
+        case OP_SUBTRACT_NUM:
+        case OP_MULTIPLY_NUM:
+        case OP_DIVIDE_NUM:
+        case OP_GREATER_NUM:
+        case OP_LESS_NUM:
+        case OP_SET_PROPERTY:
+        case OP_GET_SUPER:
+            pops = 2;
+            pushes = 1;
+            return true;
+        case OP_CONDITIONAL:
+        case OP_RANGE:
+            pops = 3;
+            pushes = 1;
+            return true;
+        case OP_POP:
+        case OP_PRINT:
+        case OP_DEFINE_GLOBAL:
+        case OP_CLOSE_UPVALUE:
+        case OP_DEL:
+        case OP_METHOD:
+        case OP_INHERIT:
+        case OP_RETURN:
+            pops = 1;
+            return true;
+        case OP_CALL:
+        case OP_TAIL_CALL:
+            pops = instruction.operands[0] + 1;
+            pushes = 1;
+            return true;
+        case OP_INLINE_GUARD:
+            pops = instruction.operands[0] + 1;
+            pushes = instruction.operands[0] + 1;
+            return true;
+        case OP_SLIDE:
+            pops = instruction.operands[0] + 1;
+            pushes = 1;
+            return true;
+        case OP_BUILD_STRING:
+            pops = instruction.operands[0];
+            pushes = 1;
+            return true;
+        case OP_INVOKE:
+            pops = instruction.operands[1] + 1;
+            pushes = 1;
+            return true;
+        case OP_SUPER_INVOKE:
+            pops = instruction.operands[1] + 2;
+            pushes = 1;
+            return true;
+        case OP_JUMP:
+        case OP_LOOP:
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+std::vector<size_t> FunctionIR::targets(const Instruction& instruction) const {
+    if(isJump(instruction.op)) return {instruction.target};
+    if(instruction.op != OP_SWITCH_TABLE) return {};
+    
+    std::vector<size_t> targets;
+    for(size_t* target : chunk->switchTables[instruction.operands[0] << 8 | instruction.operands[1]].targets()) {
+        targets.push_back(*target);
+    }
+    
+    return targets;
+}
+
+std::unordered_set<size_t> FunctionIR::labels() const {
+    std::unordered_set<size_t> labels;
+    for(const Instruction& instruction : instructions) {
+        if(instruction.removed) continue;
+        for(size_t target : targets(instruction)) labels.insert(target);
+    }
+    
+    return labels;
+}
+
+void FunctionIR::buildBlocks() {
+    std::unordered_set<size_t> jumpTargets = labels();
+    
+    //Maps the index of the first instruction of each block to the block
+    std::unordered_map<size_t, size_t> blockAt;
+    for(size_t i = 0; i < instructions.size(); i++) {
+        bool leader = i == 0 || jumpTargets.count(instructions[i].offset);
+        if(i > 0) {
+            uint8_t previous = instructions[i - 1].op;
+            leader = leader || isJump(previous) || previous == OP_SWITCH_TABLE || previous == OP_RETURN;
+        }
+        
+        if(leader) {
+            if(!blocks.empty()) blocks.back().end = i;
+            blockAt[i] = blocks.size();
+            blocks.push_back(BasicBlock{i, instructions.size(), {}});
+        }
+    }
+    
+    for(BasicBlock& block : blocks) {
+        const Instruction& last = instructions[block.end - 1];
+        
+        for(size_t offset : targets(last)) {
+            auto target = indexOf.find(offset);
+            if(target == indexOf.end()) continue;
+            
+            size_t successor = blockAt[target->second];
+            if(std::find(block.successors.begin(), block.successors.end(), successor) == block.successors.end()) {
+                block.successors.push_back(successor);
+            }
+        }
+        
+        bool fallsThrough = last.op != OP_RETURN && last.op != OP_JUMP && last.op != OP_LOOP && last.op != OP_SWITCH_TABLE;
+        if(fallsThrough && block.end < instructions.size()) block.successors.push_back(blockAt[block.end]);
+    }
+}
+
+bool FunctionIR::computeHeights(int entryHeight) {
+    heights.assign(instructions.size(), -1);
+    if(instructions.empty()) return true;
+    
+    std::vector<size_t> worklist = {0};
+    heights[0] = entryHeight;
+    
+    while(!worklist.empty()) {
+        const BasicBlock& block = blocks[worklist.back()];
+        worklist.pop_back();
+        
+        int height = heights[block.begin];
+        for(size_t i = block.begin; i < block.end; i++) {
+            int pops, pushes;
+            if(!stackEffect(instructions[i], pops, pushes) || height < pops) return false;
+            
+            heights[i] = height;
+            height += pushes - pops;
+        }
+        
+        for(size_t successor : block.successors) {
+            int& entry = heights[blocks[successor].begin];
+            if(entry == -1) {
+                entry = height;
+                worklist.push_back(successor);
+            } else if(entry != height) {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+bool FunctionIR::lower() {
+    //Removed instructions relocate to the next surviving one
+    std::unordered_map<size_t, size_t> relocation;
+    size_t newCount = 0;
+    for(const Instruction& instruction : instructions) {
+        relocation[instruction.offset] = newCount;
+        if(!instruction.removed) newCount += instruction.length();
+    }
+    relocation[chunk->count] = newCount;
+    
+    std::vector<uint8_t> code;
+    std::vector<Line> lines;
+    code.reserve(newCount);
+    
+    for(const Instruction& instruction : instructions) {
+        if(instruction.removed) continue;
+        
+        size_t offset = code.size();
+        if(lines.empty() || lines.back().line != instruction.line || lines.back().inlinedFrom != instruction.inlinedFrom ||
+           lines.back().callLine != instruction.callLine) {
+            lines.push_back(Line{offset, instruction.line, instruction.inlinedFrom, instruction.callLine});
+        }
+        
+        code.push_back(instruction.op);
+        code.insert(code.end(), instruction.operands.begin(), instruction.operands.end());
+        if(isJump(instruction.op)) {
+            size_t end = offset + instruction.length();
+            size_t target = relocation[instruction.target];
+            size_t jump = instruction.op == OP_LOOP ? end - target : target - end;
+            if(jump > UINT16_MAX) return false;
+            
+            code.push_back((jump >> 8) & 0xff);
+            code.push_back(jump & 0xff);
+        }
+    }
+    
+    for(SwitchTable& table : chunk->switchTables) {
+        for(size_t* target : table.targets()) *target = relocation[*target];
+    }
+    
+    chunk->code = std::move(code);
+    chunk->count = chunk->code.size();
+    chunk->lines = std::move(lines);
+    chunk->lineCount = chunk->lines.size();
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef ir_hpp
+#define ir_hpp
+
+#include "pch.pch"
+#include "chunk.hpp"
+
+/// A decoded bytecode instruction
+struct Instruction {
+    /// Offset of the instruction in the chunk it was decoded from
+    size_t offset;
+    uint8_t op;
+    /// Operand bytes following the instruction, not including the jump offset of jumps, which is kept in target instead
+    std::vector<uint8_t> operands;
+    /// Offset of the jump target in the chunk it was decoded from, only used by jump instructions
+    size_t target;
+    /// Source line the instruction was compiled from
+    size_t line;
+    /// Removed instructions are skipped when the function is lowered back to bytecode
+    bool removed;
+    /// Function the instruction was inlined from and the line of the call it was inlined for, see Line
+    ObjFunction* inlinedFrom = nullptr;
+    size_t callLine = 0;
+    
+    /// Number of bytes of the instruction including operands
+    size_t length() const;
+};
+
+/// A straight run of instructions that is only entered at the top and only left at the bottom
+struct BasicBlock {
+    /// Index of the first instruction
+    size_t begin;
+    /// Index just past the last instruction
+    size_t end;
+    /// Indices of the blocks control can flow to from the end of this block
+    std::vector<size_t> successors;
+};
+
+/// Intermediate representation of a compiled function: its instructions and the control flow graph over them.
+///
+/// Passes edit the instructions in place, by changing them or marking them removed, and then lower the function
+/// back into its chunk. Lowering relocates jump targets and rebuilds the line table, so passes never deal with offsets.
+/// Passes that insert instructions give them offsets past the end of the chunk, which only serve as jump targets.
+class FunctionIR {
+    
+    /// Split the instructions into basic blocks and connect them
+    void buildBlocks();
+
+public:
+    Chunk* chunk;
+    std::vector<Instruction> instructions;
+    std::vector<BasicBlock> blocks;
+    
+    /// Index of the instruction at each offset
+    std::unordered_map<size_t, size_t> indexOf;
+    
+    /// Stack height before each instruction, counted from the frame's first slot. Filled in by computeHeights.
+    std::vector<int> heights;
+    
+    /// Decode the chunk and build its control flow graph.
+    /// @param chunk Chunk of the function
+    FunctionIR(Chunk* chunk);
+    
+    /// Check if the instruction is one of the jump instructions
+    /// @param op The instruction
+    static bool isJump(uint8_t op);
+    
+    /// Get how many values an instruction pops off the stack and how many it pushes afterwards.
+    /// Instructions that only read the top, like OP_SET_LOCAL, count as popping and pushing it back.
+    /// @param instruction The instruction
+    /// @param pops Set to the number of values popped
+    /// @param pushes Set to the number of values pushed
+    /// @return false if the stack effect of the instruction is not known
+    static bool stackEffect(const Instruction& instruction, int& pops, int& pushes);
+    
+    /// Offsets the instruction can jump to: the target of a jump or every entry of a switch table
+    /// @param instruction The instruction
+    std::vector<size_t> targets(const Instruction& instruction) const;
+    
+    /// Offsets of every instruction some jump lands on
+    std::unordered_set<size_t> labels() const;
+    
+    /// Compute the stack height before every instruction.
+    /// @param entryHeight Number of slots in use when the function starts, the callee and its parameters
+    /// @return false if the heights cannot be determined, in which case passes relying on them must not run
+    bool computeHeights(int entryHeight);
+    
+    /// Encode the instructions that were not removed back into the chunk.
+    /// @return false if a jump no longer fits in its 16 bit offset, in which case the chunk is left as it was
+    bool lower();
+};
+
+#endif /* ir_hpp */
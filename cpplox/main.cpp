@@ -4,6 +4,7 @@
 #include "flags.hpp"
 #include "loxtext/startEditor.hpp"
 #include <boost/program_options.hpp>
+#include <chrono>
 
 namespace po = boost::program_options;
 
@@ -28,29 +29,53 @@ void repl(VM* vm) {
 }
 
 void runFile(VM* vm, const char* path) {
-    std::string source = readFile(path);
-    InterpretResult result = vm->interpret(source.c_str());
+    InterpretResult result = vm->interpret(readFile(path));
     
     if(result == INTERPRET_COMPILE_ERROR) exit(65);
     if(result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
+void benchScanner(const char* path) {
+    std::string source = readFile(path);
+    Scanner scanner;
+    scanner.setSource(source);
+    
+    const int runs = 10;
+    size_t tokens = 0;
+    
+    auto begin = std::chrono::steady_clock::now();
+    for(int i = 0; i < runs; i++) {
+        scanner.rewind();
+        for(Token token = scanner.scanToken(); token.type != TOKEN_EOF; token = scanner.scanToken()) tokens++;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+    
+    double megabytes = (double)source.length() * runs / (1024 * 1024);
+    std::cout << "Scanned " << tokens / runs << " tokens in " << source.length() << " bytes, "
+              << std::fixed << std::setprecision(1) << megabytes / elapsed.count() << " MB/s\n";
+}
+
 int main(int argc, const char* argv[]) {
     
     VM vm;
     
     bool openeditor = false;
+    bool benchscanner = false;
     std::string filename = "";
     
     po::options_description desc("Allowed options");
     desc.add_options()
     ("help,h", "produce help message")
     ("print_code,p", "print the bytecode")
+    ("print_peephole", "print the bytecode before and after optimization")
+    ("optimize,O", po::value<int>(), "optimization level: 0 none, 1 constant folding and peephole (default), 2 data flow passes")
     ("trace_exec,t", "trace the execution of the byte")
     ("stress_gc,s", "stress test the garbage collector")
     ("debug_gc,d", "print debug log for garbage collector")
+    ("line_buffered,l", "flush the output of print after every line, even when it does not go to a terminal")
     ("input-file,I", po::value<std::string>(), "open given file")
-    ("editor,e", "open editor");
+    ("editor,e", "open editor")
+    ("bench_scanner,b", "measure the scanner throughput on the input file");
     
     po::positional_options_description p;
     p.add("input-file", -1);
@@ -67,6 +92,12 @@ int main(int argc, const char* argv[]) {
     if(varm.count("print_code")) {
         DEBUG_PRINT_CODE = true;
     }
+    if(varm.count("print_peephole")) {
+        DEBUG_PRINT_PEEPHOLE = true;
+    }
+    if(varm.count("optimize")) {
+        OPTIMIZATION_LEVEL = varm["optimize"].as<int>();
+    }
     if(varm.count("trace_exec")) {
         DEBUG_TRACE_EXECUTION = true;
     }
@@ -76,9 +107,15 @@ int main(int argc, const char* argv[]) {
     if(varm.count("debug_gc")) {
         DEBUG_LOG_GC = true;
     }
+    if(varm.count("line_buffered")) {
+        vm.outputBuffer.lineBuffered = true;
+    }
     if(varm.count("editor")) {
         openeditor = true;
     }
+    if(varm.count("bench_scanner")) {
+        benchscanner = true;
+    }
     if(varm.count("input-file")) {
         filename = varm["input-file"].as<std::string>();
     }
@@ -94,6 +131,7 @@ int main(int argc, const char* argv[]) {
     }
     
     if(openeditor) startEditor(filename);
+    else if(benchscanner && !filename.empty()) benchScanner(filename.c_str());
     else if(!filename.empty()) runFile(&vm, filename.c_str());
     else repl(&vm);
     
@@ -29,7 +29,15 @@ void freeObject(Obj* object, VM* vm) {
     switch (object->type) {
         case OBJ_STRING:
             if(DEBUG_LOG_GC) std::cout << "OBJ_STRING" << std::endl;
-            mem_deallocate<ObjString>((ObjString*)object, sizeof(ObjString), vm);
+            mem_deallocate<ObjString>((ObjString*)object, sizeof(ObjString) + ((ObjString*)object)->length + 1, vm);
+            break;
+        case OBJ_ROPE:
+            if(DEBUG_LOG_GC) std::cout << "OBJ_ROPE" << std::endl;
+            mem_deallocate<ObjRope>((ObjRope*)object, sizeof(ObjRope), vm);
+            break;
+        case OBJ_SLICE:
+            if(DEBUG_LOG_GC) std::cout << "OBJ_SLICE" << std::endl;
+            mem_deallocate<ObjSlice>((ObjSlice*)object, sizeof(ObjSlice), vm);
             break;
         case OBJ_FUNCTION:
             if(DEBUG_LOG_GC) std::cout << "OBJ_FUNCTION" << std::endl;
@@ -45,7 +53,8 @@ void freeObject(Obj* object, VM* vm) {
             break;
         case OBJ_CLOSURE:
             if(DEBUG_LOG_GC) std::cout << "OBJ_CLOSURE" << std::endl;
-            mem_deallocate<ObjClosure>((ObjClosure*)object, sizeof(ObjClosure), vm);
+            mem_deallocate<ObjClosure>((ObjClosure*)object,
+                                       sizeof(ObjClosure) + ((ObjClosure*)object)->upvalueCount * sizeof(Capture), vm);
             break;
         case OBJ_CLASS:
             if(DEBUG_LOG_GC) std::cout << "OBJ_CLASS" << std::endl;
@@ -70,6 +79,10 @@ void freeObject(Obj* object, VM* vm) {
                     if(DEBUG_LOG_GC) std::cout << "NATIVE_COLLECTION";
                     mem_deallocate<ObjCollectionClass>(static_cast<ObjCollectionClass*>(object), sizeof(ObjCollectionClass), vm);
                     break;
+                case NATIVE_STRING_BUILDER:
+                    if(DEBUG_LOG_GC) std::cout << "NATIVE_STRING_BUILDER";
+                    mem_deallocate<ObjStringBuilderClass>(static_cast<ObjStringBuilderClass*>(object), sizeof(ObjStringBuilderClass), vm);
+                    break;
                     
                 default:
                     if(DEBUG_LOG_GC) std::cout << "OBJ_NATIVE_CLASS...shouldn't see this";
@@ -84,6 +97,10 @@ void freeObject(Obj* object, VM* vm) {
                     if(DEBUG_LOG_GC) std::cout << "NATIVE_COLLECTION_INSTANCE";
                     mem_deallocate<ObjCollectionInstance>(static_cast<ObjCollectionInstance*>(instance), sizeof(ObjCollectionInstance), vm);
                     break;
+                case NATIVE_STRING_BUILDER_INSTANCE:
+                    if(DEBUG_LOG_GC) std::cout << "NATIVE_STRING_BUILDER_INSTANCE";
+                    mem_deallocate<ObjStringBuilderInstance>(static_cast<ObjStringBuilderInstance*>(instance), sizeof(ObjStringBuilderInstance), vm);
+                    break;
                     
                 default:
                     // should never be reached
@@ -132,6 +149,7 @@ void GarbageCollector::markRoots(VM* vm) {
     }
     
     markGlobal(&vm->globalNames, vm);
+    markTable(vm, &vm->stringMethods);
     if(vm->current != nullptr) vm->current->markCompilerRoots();
     markObject(vm, (Obj*)vm->initString);
 }
@@ -197,6 +215,8 @@ void blackenObject(Obj* object, VM* vm) {
                     }
                     break;
                 }
+                case NATIVE_STRING_BUILDER_INSTANCE:
+                    break;
             }
         }
         case OBJ_INSTANCE: {
@@ -216,7 +236,8 @@ void blackenObject(Obj* object, VM* vm) {
             ObjClosure* closure = (ObjClosure*)object;
             markObject(vm, (Obj*)closure->function);
             for(int i = 0; i < closure->upvalueCount; i++) {
-                markObject(vm, (Obj*)closure->upvalues[i]);
+                markObject(vm, (Obj*)closure->upvalues[i].upvalue);
+                markValue(vm, closure->upvalues[i].value);
             }
             break;
         }
@@ -229,6 +250,17 @@ void blackenObject(Obj* object, VM* vm) {
         case OBJ_UPVALUE:
             markValue(vm, ((ObjUpvalue*)object)->closed);
             break;
+        case OBJ_ROPE: {
+            ObjRope* rope = (ObjRope*)object;
+            markObject(vm, rope->left);
+            markObject(vm, rope->right);
+            markObject(vm, (Obj*)rope->flat);
+            break;
+        }
+        case OBJ_SLICE:
+            markObject(vm, (Obj*)((ObjSlice*)object)->parent);
+            markObject(vm, (Obj*)((ObjSlice*)object)->flat);
+            break;
         case OBJ_NATIVE:
         case OBJ_NATIVE_CLASS_METHOD:
         case OBJ_STRING:
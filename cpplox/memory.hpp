@@ -47,7 +47,9 @@ V* mem_allocate(size_t newsize, VM* vm) {
         GarbageCollector::collectGarbage(vm);
     }
     
-    V* result = new V;
+    //Sizes past the object itself leave room for data stored right after it, like the captures of a closure
+    void* memory = ::operator new(std::max(newsize, sizeof(V)));
+    V* result = new(memory) V;
     return result;
 }
 
@@ -56,7 +58,8 @@ template<typename V>
 void mem_deallocate(V* pointer, size_t oldsize, VM* vm) {
     vm->bytesAllocated -= oldsize;
     
-    delete pointer;
+    pointer->~V();
+    ::operator delete(pointer);
 }
 
 template<typename T>
@@ -0,0 +1,115 @@
+#include "module.hpp"
+#include "util.hpp"
+#include <filesystem>
+#include <thread>
+#include <atomic>
+
+std::string ModuleLoader::resolvePath(const std::string& importer, const std::string& name) {
+    size_t path_index = importer.rfind("/");
+    std::filesystem::path module_option = importer.substr(0, path_index == std::string::npos ? 0 : path_index + 1) + name;
+    
+    module_option += ".lox";
+    return std::filesystem::absolute(module_option).string();
+}
+
+std::vector<std::string> ModuleLoader::scanImports(Scanner* scanner) {
+    std::vector<std::string> names;
+    
+    Token token = scanner->scanToken();
+    while(token.type != TOKEN_EOF) {
+        if(token.type != TOKEN_IMPORT) {
+            token = scanner->scanToken();
+            continue;
+        }
+        
+        token = scanner->scanToken();
+        if(token.type == TOKEN_STRING) {
+            names.push_back(std::string(token.source.substr(1, token.source.size() - 2)));
+        }
+    }
+    
+    scanner->rewind();
+    return names;
+}
+
+std::unique_ptr<Scanner> ModuleLoader::load(const std::string& path) {
+    std::unique_ptr<Scanner> scanner = std::make_unique<Scanner>();
+    scanner->setSource(readFile(path.c_str()));
+    scanner->tokenize();
+    return scanner;
+}
+
+void ModuleLoader::preload(const std::string& rootPath, Scanner* root) {
+    scanners.clear();
+    errors.clear();
+    
+    //A script that never mentions import has nothing to preload and keeps scanning lazily
+    if(root->source.find("import") == std::string::npos) return;
+    
+    //The compiler parses the root from the same token array, so its source is only scanned once
+    root->tokenize();
+    
+    std::unordered_set<std::string> discovered;
+    std::vector<std::string> level;
+    for(const std::string& name : scanImports(root)) {
+        std::string path = resolvePath(rootPath, name);
+        if(discovered.insert(path).second) level.push_back(path);
+    }
+    if(level.empty()) return;
+    
+    size_t workerCount = std::max(1u, std::thread::hardware_concurrency());
+    
+    while(!level.empty()) {
+        // Loading a module does not depend on any other module, so the whole level is loaded at once.
+        std::vector<std::unique_ptr<Scanner>> loaded(level.size());
+        std::vector<std::string> failed(level.size());
+        std::vector<std::vector<std::string>> imports(level.size());
+        std::atomic<size_t> next(0);
+        
+        auto worker = [&]() {
+            for(size_t i = next++; i < level.size(); i = next++) {
+                try {
+                    loaded[i] = load(level[i]);
+                    imports[i] = scanImports(loaded[i].get());
+                } catch(std::string e) {
+                    failed[i] = e;
+                }
+            }
+        };
+        
+        std::vector<std::thread> workers;
+        for(size_t i = 1; i < std::min(workerCount, level.size()); i++) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for(std::thread& thread : workers) thread.join();
+        
+        std::vector<std::string> nextLevel;
+        for(size_t i = 0; i < level.size(); i++) {
+            if(!failed[i].empty()) {
+                errors[level[i]] = std::move(failed[i]);
+                continue;
+            }
+            
+            for(const std::string& name : imports[i]) {
+                std::string path = resolvePath(level[i], name);
+                if(discovered.insert(path).second) nextLevel.push_back(path);
+            }
+            scanners[level[i]] = std::move(loaded[i]);
+        }
+        
+        level.swap(nextLevel);
+    }
+}
+
+Scanner* ModuleLoader::scanner(const std::string& path) {
+    auto error = errors.find(path);
+    if(error != errors.end()) throw error->second;
+    
+    auto loaded = scanners.find(path);
+    if(loaded == scanners.end()) {
+        loaded = scanners.emplace(path, load(path)).first;
+    }
+    
+    return loaded->second.get();
+}
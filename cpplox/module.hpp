@@ -0,0 +1,51 @@
+#ifndef module_hpp
+#define module_hpp
+
+#include "pch.pch"
+#include "scanner.hpp"
+#include <memory>
+
+/// Loads every module reachable through import statements before compilation starts.
+///
+/// The import graph is discovered breadth first. Every module on the same level is independent of the others,
+/// so they are read and tokenized on a pool of worker threads. The compiler then parses the token arrays directly.
+/// Compilation itself stays serial: the compiler interns strings in the VM, allocates garbage collected objects,
+/// and hands out global slots, and doing that in source order keeps the global slot assignment deterministic.
+class ModuleLoader {
+    
+    /// Tokenized source of each loaded module, keyed by absolute path.
+    std::unordered_map<std::string, std::unique_ptr<Scanner>> scanners;
+    
+    /// Error message of each module that failed to load, keyed by absolute path.
+    std::unordered_map<std::string, std::string> errors;
+    
+    /// Collect the names of all modules imported by the source of the given scanner.
+    /// @param scanner Scanner holding the source, rewound before returning.
+    static std::vector<std::string> scanImports(Scanner* scanner);
+    
+    /// Read and tokenize a module.
+    /// Throws the same error message as readFile if the module cannot be read.
+    /// @param path Absolute path of the module.
+    static std::unique_ptr<Scanner> load(const std::string& path);
+
+public:
+    
+    /// Resolve the name used in an import statement to the absolute path of the module.
+    /// @param importer Path of the file containing the import statement.
+    /// @param name Module name as written in the import statement, without quotes.
+    static std::string resolvePath(const std::string& importer, const std::string& name);
+    
+    /// Build the import graph rooted at the given source and load every module in it.
+    /// Modules loaded by a previous call are discarded.
+    /// If the root imports anything it is tokenized in place, so compiling it afterwards reads the same tokens.
+    /// @param rootPath Path of the root source, used to resolve relative imports.
+    /// @param root Scanner holding the root source, rewound before returning.
+    void preload(const std::string& rootPath, Scanner* root);
+    
+    /// Return the scanner holding the tokenized source of a module. Modules that were not discovered by preload are loaded on demand.
+    /// Throws the same error message as readFile if the module cannot be read.
+    /// @param path Absolute path of the module.
+    Scanner* scanner(const std::string& path);
+};
+
+#endif /* module_hpp */
@@ -9,7 +9,7 @@ Number Number::gen_whole_num(long long whole) {
 
 Number Number::gen_float_num(double decimal) {
     Number num;
-    num.is_float = false;
+    num.is_float = true;
     num.number.decimal = decimal;
     return num;
 }
@@ -20,7 +20,8 @@ bool operator==(Number const& lhs, Number const& rhs) {
 }
 
 bool operator< (Number const& lhs, Number const& rhs) {
-    return (lhs.is_float ? lhs.number.decimal : rhs.number.whole) < (rhs.is_float ? rhs.number.decimal : rhs.number.whole);
+    if(!lhs.is_float && !rhs.is_float) return lhs.number.whole < rhs.number.whole;
+    return (lhs.is_float ? lhs.number.decimal : lhs.number.whole) < (rhs.is_float ? rhs.number.decimal : rhs.number.whole);
 }
 
 bool operator> (Number const& lhs, Number const& rhs) {
@@ -40,9 +41,11 @@ Number operator+ (Number const& lhs, Number const& rhs) {
     if(lhs.is_float || rhs.is_float) {
         num.is_float = true;
         num.number.decimal = (lhs.is_float ? lhs.number.decimal : lhs.number.whole) + (rhs.is_float ? rhs.number.decimal : rhs.number.whole);
+    } else if(__builtin_add_overflow(lhs.number.whole, rhs.number.whole, &num.number.whole)) {
+        num.is_float = true;
+        num.number.decimal = (double)lhs.number.whole + (double)rhs.number.whole;
     } else {
         num.is_float = false;
-        num.number.whole = lhs.number.whole + rhs.number.whole;
     }
     
     return num;
@@ -53,9 +56,11 @@ Number operator- (Number const& lhs, Number const& rhs) {
     if(lhs.is_float || rhs.is_float) {
         num.is_float = true;
         num.number.decimal = (lhs.is_float ? lhs.number.decimal : lhs.number.whole) - (rhs.is_float ? rhs.number.decimal : rhs.number.whole);
+    } else if(__builtin_sub_overflow(lhs.number.whole, rhs.number.whole, &num.number.whole)) {
+        num.is_float = true;
+        num.number.decimal = (double)lhs.number.whole - (double)rhs.number.whole;
     } else {
         num.is_float = false;
-        num.number.whole = lhs.number.whole - rhs.number.whole;
     }
     
     return num;
@@ -66,9 +71,11 @@ Number operator* (Number const& lhs, Number const& rhs) {
     if(lhs.is_float || rhs.is_float) {
         num.is_float = true;
         num.number.decimal = (lhs.is_float ? lhs.number.decimal : lhs.number.whole) * (rhs.is_float ? rhs.number.decimal : rhs.number.whole);
+    } else if(__builtin_mul_overflow(lhs.number.whole, rhs.number.whole, &num.number.whole)) {
+        num.is_float = true;
+        num.number.decimal = (double)lhs.number.whole * (double)rhs.number.whole;
     } else {
         num.is_float = false;
-        num.number.whole = lhs.number.whole * rhs.number.whole;
     }
     
     return num;
@@ -77,6 +84,7 @@ Number operator* (Number const& lhs, Number const& rhs) {
 Number operator- (Number const& rhs) {
     Number num = rhs;
     if(num.is_float) num.number.decimal = -num.number.decimal;
+    else if(num.number.whole == LLONG_MIN) num = Number::gen_float_num(-(double)LLONG_MIN);
     else num.number.whole = -num.number.whole;
     
     return num;
@@ -89,8 +97,86 @@ Number operator/ (Number const& lhs, Number const& rhs) {
     return num;
 }
 
+Number operator% (Number const& lhs, Number const& rhs) {
+    if(lhs.is_float || rhs.is_float) {
+        return Number::gen_float_num(std::fmod(Number::cast_to<double>(lhs), Number::cast_to<double>(rhs)));
+    }
+    
+    //The smallest whole number divided by -1 overflows
+    if(rhs.number.whole == -1) return Number::gen_whole_num(0);
+    return Number::gen_whole_num(lhs.number.whole % rhs.number.whole);
+}
+
+Number intDivide(Number const& lhs, Number const& rhs) {
+    if(lhs.is_float || rhs.is_float) {
+        return Number::gen_float_num(std::trunc(Number::cast_to<double>(lhs) / Number::cast_to<double>(rhs)));
+    }
+    
+    if(rhs.number.whole == -1) return -lhs;
+    return Number::gen_whole_num(lhs.number.whole / rhs.number.whole);
+}
+
+Number operator& (Number const& lhs, Number const& rhs) {
+    return Number::gen_whole_num(lhs.number.whole & rhs.number.whole);
+}
+
+Number operator| (Number const& lhs, Number const& rhs) {
+    return Number::gen_whole_num(lhs.number.whole | rhs.number.whole);
+}
+
+Number operator^ (Number const& lhs, Number const& rhs) {
+    return Number::gen_whole_num(lhs.number.whole ^ rhs.number.whole);
+}
+
+Number operator~ (Number const& rhs) {
+    return Number::gen_whole_num(~rhs.number.whole);
+}
+
+Number shiftLeft(Number const& lhs, Number const& rhs) {
+    //Shifting is done unsigned, bits shifted past the sign bit are simply lost
+    return Number::gen_whole_num((long long)((unsigned long long)lhs.number.whole << rhs.number.whole));
+}
+
+Number shiftRight(Number const& lhs, Number const& rhs) {
+    return Number::gen_whole_num(lhs.number.whole >> rhs.number.whole);
+}
+
+Number shiftRightUnsigned(Number const& lhs, Number const& rhs) {
+    return Number::gen_whole_num((long long)((unsigned long long)lhs.number.whole >> rhs.number.whole));
+}
+
+char* Number::toChars(char* first) const {
+    if(!is_float) return std::to_chars(first, first + MAX_CHARS, number.whole).ptr;
+    
+    //Floating point to_chars needs macOS 13.3, so take the fewest significant digits that parse back to the same double
+    int length = 0;
+    for(int precision = 15; precision <= 17; precision++) {
+        length = snprintf(first, MAX_CHARS, "%.*g", precision, number.decimal);
+        if(strtod(first, nullptr) == number.decimal) break;
+    }
+    
+    char* last = first + length;
+    //A float without a fraction or exponent would read back as a whole number
+    if(std::isfinite(number.decimal) && std::find_if(first, last, [](char c) { return c == '.' || c == 'e'; }) == last) {
+        *last++ = '.';
+        *last++ = '0';
+    }
+    return last;
+}
+
+bool Number::parseFloat(std::string_view text, double& value) {
+    //strtod needs a terminated string and number literals are short
+    std::string terminated(text);
+    char* end;
+    errno = 0;
+    value = strtod(terminated.c_str(), &end);
+    //Underflow also reports ERANGE but still gives the nearest double, only overflow is out of range
+    return !(errno == ERANGE && std::isinf(value)) && end == terminated.c_str() + terminated.size() && !terminated.empty();
+}
+
 std::ostream& operator<<(std::ostream& os, Number const& num) {
-    os << (num.is_float ? num.number.decimal : num.number.whole);
+    char text[Number::MAX_CHARS];
+    os.write(text, num.toChars(text) - text);
     return os;
 }
 
@@ -27,6 +27,20 @@ struct Number {
     static Number gen_whole_num(long long whole);
     static Number gen_float_num(double decimal);
     
+    /// Enough room for any number toChars writes
+    static constexpr size_t MAX_CHARS = 32;
+    
+    /// Write the number as text. Floats get the fewest of 15, 16 or 17 significant digits that parse back to the same double,
+    /// with a trailing .0 when that text would otherwise read as a whole number.
+    /// @param first Start of a buffer of at least MAX_CHARS characters
+    /// @return Pointer past the last character written
+    char* toChars(char* first) const;
+    
+    /// Parse the whole text as a double. Floating point from_chars is missing from the libc++ of the macOS versions
+    /// the project targets, so floats go through strtod while whole numbers keep using from_chars.
+    /// @return false if the text is not a number or is too large for a double
+    static bool parseFloat(std::string_view text, double& value);
+    
     template <typename T>
     static T cast_to(Number const & t) {
         static_assert(is_built_in_v<T>, "Must cast to built in type");
@@ -42,12 +56,28 @@ bool operator> (Number const& lhs, Number const& rhs);
 bool operator<= (Number const& lhs, Number const& rhs);
 bool operator>= (Number const& lhs, Number const& rhs);
 
+//Arithmetic on two whole numbers stays whole unless the result overflows, in which case it becomes a float
 Number operator+ (Number const& lhs, Number const& rhs);
 Number operator- (Number const& lhs, Number const& rhs);
 Number operator* (Number const& lhs, Number const& rhs);
 Number operator/ (Number const& lhs, Number const& rhs);
 Number operator- (Number const& rhs);
 
+/// Remainder of the division rounding towards zero, which has the sign of the left operand
+Number operator% (Number const& lhs, Number const& rhs);
+
+/// Division rounding towards zero, whole if both operands are whole
+Number intDivide(Number const& lhs, Number const& rhs);
+
+//Bitwise operators, only defined for whole numbers. Shift counts must be between 0 and 63.
+Number operator& (Number const& lhs, Number const& rhs);
+Number operator| (Number const& lhs, Number const& rhs);
+Number operator^ (Number const& lhs, Number const& rhs);
+Number operator~ (Number const& rhs);
+Number shiftLeft(Number const& lhs, Number const& rhs);
+Number shiftRight(Number const& lhs, Number const& rhs);
+Number shiftRightUnsigned(Number const& lhs, Number const& rhs);
+
 namespace std {
 Number abs(Number const & n);
 };
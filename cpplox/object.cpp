@@ -7,21 +7,77 @@
 #include "debug.hpp"
 
 
+//Multiply two words and fold the halves of the 128 bit product, the mixing step of the hash
+static inline uint64_t hashMix(uint64_t a, uint64_t b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
 uint32_t ObjString::hashString(const char* key, size_t length) {
-    uint32_t hash = 2166136261u;
+    //wyhash: whole words are mixed with multiplications, and long strings in 48 byte blocks of three independent lanes
+    static const uint64_t secret[4] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull};
+    const uint8_t* p = (const uint8_t*)key;
+    uint64_t seed = hashMix(secret[0], secret[1]);
+    uint64_t a, b;
     
-    for (int i = 0; i < length; i++) {
-        hash ^= (uint8_t)key[i];
-        hash *= 16777619;
+    if(length <= 16) {
+        if(length >= 4) {
+            //Two overlapping reads from each end cover every byte
+            size_t middle = (length >> 3) << 2;
+            a = read32(p) << 32 | read32(p + middle);
+            b = read32(p + length - 4) << 32 | read32(p + length - 4 - middle);
+        } else if(length > 0) {
+            a = (uint64_t)p[0] << 16 | (uint64_t)p[length >> 1] << 8 | p[length - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t remaining = length;
+        if(remaining > 48) {
+            uint64_t lane1 = seed, lane2 = seed;
+            do {
+                seed = hashMix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+                lane1 = hashMix(read64(p + 16) ^ secret[2], read64(p + 24) ^ lane1);
+                lane2 = hashMix(read64(p + 32) ^ secret[3], read64(p + 40) ^ lane2);
+                p += 48;
+                remaining -= 48;
+            } while(remaining > 48);
+            seed ^= lane1 ^ lane2;
+        }
+        
+        while(remaining > 16) {
+            seed = hashMix(read64(p) ^ secret[1], read64(p + 8) ^ seed);
+            p += 16;
+            remaining -= 16;
+        }
+        
+        //The last 16 bytes, which may overlap the ones already mixed
+        a = read64(p + remaining - 16);
+        b = read64(p + remaining - 8);
     }
     
-    return hash;
+    __uint128_t product = (__uint128_t)(a ^ secret[1]) * (b ^ seed);
+    uint64_t hash = hashMix((uint64_t)product ^ secret[0] ^ length, (uint64_t)(product >> 64) ^ secret[1]);
+    return (uint32_t)(hash ^ hash >> 32);
 }
 
 
 template<typename T>
-T* Obj::allocate_obj(ObjType objectType, VM* vm) {
-    Obj* object = (Obj* )mem_allocate<T>(sizeof(T), vm);
+T* Obj::allocate_obj(ObjType objectType, VM* vm, size_t trailing) {
+    Obj* object = (Obj* )mem_allocate<T>(sizeof(T) + trailing, vm);
     object->type = objectType;
     object->mark = !vm->marker;
     
@@ -34,49 +90,148 @@ T* Obj::allocate_obj(ObjType objectType, VM* vm) {
     return (T*)object;
 }
 
-ObjString* ObjString::makeString(VM* vm, size_t length, uint32_t hash) {
-    ObjString* string = Obj::allocate_obj<ObjString>(OBJ_STRING, vm);
-    string->hash = hash;
+ObjString* ObjString::allocateString(VM* vm, size_t length) {
+    ObjString* string = Obj::allocate_obj<ObjString>(OBJ_STRING, vm, length + 1);
+    string->hashed = false;
+    string->interned = false;
+    string->length = length;
+    string->chars()[length] = '\0';
+    return string;
+}
+
+uint32_t ObjString::getHash() {
+    if(!hashed) {
+        hash = hashString(chars(), length);
+        hashed = true;
+    }
     
-    vm->stack.push_back(ValueOP::obj_val(string));
+    return hash;
+}
+
+ObjString* ObjString::intern(VM* vm) {
+    if(interned) return this;
     
-    vm->strings.tableSet(ValueOP::obj_val(string), ValueOP::nul_val());
+    ObjString* existing = vm->strings.tableFindString(chars(), length, getHash());
+    if(existing != nullptr) return existing;
     
+    interned = true;
+    vm->stack.push_back(ValueOP::obj_val(this));
+    vm->strings.tableSet(ValueOP::obj_val(this), ValueOP::nul_val());
     vm->stack.pop_back();
     
-    return string;
+    return this;
 }
 
-ObjString* ObjString::copyString(VM* vm, std::string& chars) {
-    uint32_t hash = hashString(chars.c_str(), chars.size());
-    ObjString* interned = vm->strings.tableFindString(chars.c_str(), chars.size(),
+ObjString* ObjString::copyString(VM* vm, std::string_view chars) {
+    uint32_t hash = hashString(chars.data(), chars.size());
+    ObjString* interned = vm->strings.tableFindString(chars.data(), chars.size(),
                                                       hash);
     
     if (interned != nullptr) {
         return interned;
     }
     
-    ObjString* string = makeString(vm, chars.size(), hash);
-    string->chars = chars;
-    
+    ObjString* string = newString(vm, chars);
+    string->hash = hash;
+    string->hashed = true;
+    return string->intern(vm);
+}
+
+ObjString* ObjString::newString(VM* vm, std::string_view chars) {
+    ObjString* string = allocateString(vm, chars.size());
+    memcpy(string->chars(), chars.data(), chars.size());
     return string;
 }
 
-ObjString* ObjString::copyString(VM* vm, std::string&& chars) {
-    uint32_t hash = hashString(chars.c_str(), chars.size());
-    ObjString* interned = vm->strings.tableFindString(chars.c_str(), chars.size(),
-                                                      hash);
+ObjString* ObjString::concatenate(VM* vm, std::string_view a, std::string_view b) {
+    ObjString* string = allocateString(vm, a.size() + b.size());
+    memcpy(string->chars(), a.data(), a.size());
+    memcpy(string->chars() + a.size(), b.data(), b.size());
+    return string;
+}
+
+ObjRope* ObjRope::newRope(VM* vm, Obj* left, Obj* right, size_t length) {
+    if(left->type == OBJ_ROPE && ((ObjRope*)left)->flat != nullptr) left = ((ObjRope*)left)->flat;
+    if(right->type == OBJ_ROPE && ((ObjRope*)right)->flat != nullptr) right = ((ObjRope*)right)->flat;
     
-    if (interned != nullptr) {
-        return interned;
+    ObjRope* rope = allocate_obj<ObjRope>(OBJ_ROPE, vm);
+    rope->vm = vm;
+    rope->length = length;
+    rope->left = left;
+    rope->right = right;
+    rope->flat = nullptr;
+    return rope;
+}
+
+void ObjRope::appendTo(std::string& buffer) const {
+    if(flat != nullptr) {
+        buffer += flat->view();
+        return;
     }
     
-    ObjString* string = makeString(vm, chars.size(), hash);
-    string->chars = std::move(chars);
+    //Ropes built in a loop are as deep as the loop is long, so the halves are walked with an explicit stack
+    std::vector<Obj*> pending = {right, left};
+    while(!pending.empty()) {
+        Obj* part = pending.back();
+        pending.pop_back();
+        
+        if(part->type == OBJ_STRING) {
+            buffer += ((ObjString*)part)->view();
+        } else if(part->type == OBJ_SLICE) {
+            buffer += ((ObjSlice*)part)->view();
+        } else if(((ObjRope*)part)->flat != nullptr) {
+            buffer += ((ObjRope*)part)->flat->view();
+        } else {
+            pending.push_back(((ObjRope*)part)->right);
+            pending.push_back(((ObjRope*)part)->left);
+        }
+    }
+}
+
+ObjString* ObjRope::flatten() {
+    if(flat != nullptr) return flat;
     
-    return string;
+    std::string buffer;
+    buffer.reserve(length);
+    appendTo(buffer);
+    
+    flat = ObjString::newString(vm, buffer);
+    left = nullptr;
+    right = nullptr;
+    return flat;
 }
 
+Value ObjSlice::substring(VM* vm, Value string, size_t offset, size_t length) {
+    ObjString* parent;
+    if(ValueOP::isObjType(string, OBJ_SLICE) && ValueOP::as_slice(string)->flat == nullptr) {
+        parent = ValueOP::as_slice(string)->parent;
+        offset += ValueOP::as_slice(string)->offset;
+    } else {
+        parent = ValueOP::isObjType(string, OBJ_SLICE) ? ValueOP::as_slice(string)->flat : ValueOP::as_string(string);
+    }
+    
+    if(offset == 0 && length == parent->length) return ValueOP::obj_val(parent);
+    if(length == 0) return ValueOP::obj_val(ObjString::copyString(vm, ""));
+    if(parent->length - length > SLICE_RETAIN_LIMIT) {
+        return ValueOP::obj_val(ObjString::newString(vm, parent->view().substr(offset, length)));
+    }
+    
+    ObjSlice* slice = allocate_obj<ObjSlice>(OBJ_SLICE, vm);
+    slice->vm = vm;
+    slice->parent = parent;
+    slice->offset = offset;
+    slice->length = length;
+    slice->flat = nullptr;
+    return ValueOP::obj_val(slice);
+}
+
+ObjString* ObjSlice::materialize() {
+    if(flat != nullptr) return flat;
+    
+    flat = ObjString::newString(vm, view());
+    parent = nullptr;
+    return flat;
+}
 
 ObjFunction* ObjFunction::newFunction(VM* vm, FunctionType type) {
     ObjFunction* function = allocate_obj<ObjFunction>(OBJ_FUNCTION, vm);
@@ -98,10 +253,15 @@ ObjNative* ObjNative::newNative(NativeFn function, int arity, VM* vm) {
 }
 
 ObjClosure* ObjClosure::newClosure(ObjFunction* function, VM* vm) {
-    ObjClosure* closure = allocate_obj<ObjClosure>(OBJ_CLOSURE, vm);
+    static_assert(sizeof(ObjClosure) % alignof(Capture) == 0, "Captures must be aligned right after the closure");
+    
+    ObjClosure* closure = allocate_obj<ObjClosure>(OBJ_CLOSURE, vm, function->upvalueCount * sizeof(Capture));
     closure->function = function;
-    closure->upvalues = std::vector<ObjUpvalue*>(function->upvalueCount, nullptr);
+    closure->upvalues = reinterpret_cast<Capture*>(closure + 1);
     closure->upvalueCount = function->upvalueCount;
+    for(int i = 0; i < closure->upvalueCount; i++) {
+        new(&closure->upvalues[i]) Capture{nullptr, ValueOP::nul_val()};
+    }
     return closure;
 }
 
@@ -274,3 +434,94 @@ NativeClassRes ObjCollectionClass::deleteIndex(ObjNativeInstance *instance, int
     collection->values.count--;
     return NativeClassRes::genResponse(ValueOP::empty_val(), true);
 }
+
+NativeClassRes ObjStringBuilderClass::invokeMethod(ObjString* name, ObjNativeInstance* instance, int argCount, Value* args) {
+    Value seek_method, name_val = ValueOP::obj_val(name);
+    if(methods.tableGet(name_val, &seek_method)) {
+        ObjNativeClassMethod* method_wrapper = static_cast<ObjNativeClassMethod*>(ValueOP::as_obj(seek_method));
+        StringBuilderClassMethod builder_method = static_cast<StringBuilderClassMethod>(method_wrapper->method);
+        return std::invoke(builder_method, *this, instance, argCount, args);
+    } else {
+        return NativeClassRes::genError("Property Not Found.", true);
+    }
+}
+
+NativeClassRes ObjStringBuilderClass::init(ObjNativeInstance* instance, int argCount, Value* args) {
+    for(int i = 0; i < argCount; i++) {
+        ValueOP::append_string(args[i], static_cast<ObjStringBuilderInstance*>(instance)->buffer);
+    }
+    
+    return NativeClassRes::genResponse(ValueOP::nul_val(), true);
+}
+
+NativeClassRes ObjStringBuilderClass::append(ObjNativeInstance* instance, int argCount, Value* args) {
+    if(argCount != 1)
+        return NativeClassRes::genError("Expected 1 argument, got " + std::to_string(argCount) + " instead.");
+    
+    //Values are formatted straight into the buffer, which grows geometrically, so appending is amortized constant time
+    ValueOP::append_string(args[0], static_cast<ObjStringBuilderInstance*>(instance)->buffer);
+    return NativeClassRes::genResponse(ValueOP::obj_val(instance));
+}
+
+NativeClassRes ObjStringBuilderClass::appendLine(ObjNativeInstance* instance, int argCount, Value* args) {
+    if(argCount > 1)
+        return NativeClassRes::genError("Expected at most 1 argument, got " + std::to_string(argCount) + " instead.");
+    
+    std::string& buffer = static_cast<ObjStringBuilderInstance*>(instance)->buffer;
+    if(argCount == 1) ValueOP::append_string(args[0], buffer);
+    buffer += '\n';
+    return NativeClassRes::genResponse(ValueOP::obj_val(instance));
+}
+
+NativeClassRes ObjStringBuilderClass::length(ObjNativeInstance* instance, int argCount, Value* args) {
+    if(argCount != 0)
+        return NativeClassRes::genError("Expected 0 argument, got " + std::to_string(argCount) + " instead.");
+    
+    return NativeClassRes::genResponse(ValueOP::number_val((long long)static_cast<ObjStringBuilderInstance*>(instance)->buffer.size()));
+}
+
+NativeClassRes ObjStringBuilderClass::clear(ObjNativeInstance* instance, int argCount, Value* args) {
+    if(argCount != 0)
+        return NativeClassRes::genError("Expected 0 argument, got " + std::to_string(argCount) + " instead.");
+    
+    //The capacity is kept, so a builder reused in a loop stops allocating
+    static_cast<ObjStringBuilderInstance*>(instance)->buffer.clear();
+    return NativeClassRes::genResponse(ValueOP::empty_val(), true);
+}
+
+NativeClassRes ObjStringBuilderClass::toString(ObjNativeInstance* instance, int argCount, Value* args) {
+    if(argCount != 0)
+        return NativeClassRes::genError("Expected 0 argument, got " + std::to_string(argCount) + " instead.");
+    
+    return NativeClassRes::genResponse(ValueOP::obj_val(ObjString::newString(vm, static_cast<ObjStringBuilderInstance*>(instance)->buffer)));
+}
+
+ObjStringBuilderClass* ObjStringBuilderClass::newStringBuilderClass(ObjString* name, VM* vm) {
+    ObjStringBuilderClass* builder = allocate_obj<ObjStringBuilderClass>(OBJ_NATIVE_CLASS, vm);
+    builder->hasInitializer = true;
+    builder->subType = NATIVE_STRING_BUILDER;
+    builder->vm = vm;
+    
+    builder->name = name;
+    builder->methods = Table(vm);
+    builder->initializer = nullptr;
+    
+    builder->addMethod("init", static_cast<NativeClassMethod>(&ObjStringBuilderClass::init), vm);
+    builder->addMethod("append", static_cast<NativeClassMethod>(&ObjStringBuilderClass::append), vm);
+    builder->addMethod("appendLine", static_cast<NativeClassMethod>(&ObjStringBuilderClass::appendLine), vm);
+    builder->addMethod("length", static_cast<NativeClassMethod>(&ObjStringBuilderClass::length), vm);
+    builder->addMethod("clear", static_cast<NativeClassMethod>(&ObjStringBuilderClass::clear), vm);
+    builder->addMethod("toString", static_cast<NativeClassMethod>(&ObjStringBuilderClass::toString), vm);
+    
+    return builder;
+}
+
+ObjStringBuilderInstance* ObjStringBuilderInstance::newStringBuilderInstance(ObjStringBuilderClass* _class, VM* vm) {
+    ObjStringBuilderInstance* instance = allocate_obj<ObjStringBuilderInstance>(OBJ_NATIVE_INSTANCE, vm);
+    instance->_class = _class;
+    instance->subType = NATIVE_STRING_BUILDER_INSTANCE;
+    
+    instance->fields = Table(vm);
+    
+    return instance;
+}
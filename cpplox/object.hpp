@@ -10,6 +10,8 @@ class VM;
 
 enum ObjType : short{
     OBJ_STRING,
+    OBJ_ROPE,
+    OBJ_SLICE,
     OBJ_FUNCTION,
     OBJ_NATIVE,
     OBJ_CLOSURE,
@@ -24,10 +26,12 @@ enum ObjType : short{
 
 enum NativeClassType : short {
     NATIVE_COLLECTION,
+    NATIVE_STRING_BUILDER,
 };
 
 enum NativeInstanceType : short {
-    NATIVE_COLLECTION_INSTANCE
+    NATIVE_COLLECTION_INSTANCE,
+    NATIVE_STRING_BUILDER_INSTANCE
 };
 
 enum FunctionType : short {
@@ -48,21 +52,106 @@ public:
     bool mark;
     
     template<typename T>
-    static T* allocate_obj(ObjType objectType, VM* vm);
+    static T* allocate_obj(ObjType objectType, VM* vm, size_t trailing = 0);
 };
 
+/// A string is a single allocation: the object is followed by its characters and a terminating null character.
+///
+/// Strings made while the program runs are transient: they are neither hashed nor interned until they are used as
+/// a table key or in a switch, so programs streaming many unique strings do not fill VM::strings. Interned strings
+/// are equal only to themselves, transient ones are compared by their characters.
 class ObjString : public Obj {
-    
-    static ObjString* makeString(VM* vm, size_t length, uint32_t hash);
-    
 public:
+    /// Only valid once hashed is set, use getHash
     uint32_t hash;
-    std::string chars;
-    static ObjString* copyString(VM* vm, std::string& chars);
-    static ObjString* copyString(VM* vm, std::string&& chars);
+    bool hashed;
+    /// Whether this is the string in VM::strings with these characters
+    bool interned;
+    /// Number of characters, not counting the null character
+    size_t length;
+    
+    /// Characters of the string, null terminated
+    char* chars() { return reinterpret_cast<char*>(this + 1); }
+    const char* chars() const { return reinterpret_cast<const char*>(this + 1); }
+    std::string_view view() const { return std::string_view(chars(), length); }
+    
+    /// Hash of the characters, computed the first time it is needed
+    uint32_t getHash();
+    
+    /// Get the interned string with the same characters, interning this string if there is none yet
+    ObjString* intern(VM* vm);
+    
+    /// Get the interned string with the given characters, creating it if it does not exist yet
+    static ObjString* copyString(VM* vm, std::string_view chars);
+    
+    /// Create a transient string with the given characters
+    static ObjString* newString(VM* vm, std::string_view chars);
+    
+    /// Allocate a transient string of the given length, whose characters are filled in by the caller
+    static ObjString* allocateString(VM* vm, size_t length);
+    
+    /// Create a transient string made of two strings one after the other
+    static ObjString* concatenate(VM* vm, std::string_view a, std::string_view b);
+    
     static uint32_t hashString(const char* key, size_t length);
 };
 
+/// A string made of two strings one after the other, whose characters are only copied into a single transient string
+/// once they are needed: when the rope is hashed, compared, used as a key or printed.
+/// Building a long string piece by piece thereby copies it once instead of on every concatenation.
+class ObjRope : public Obj {
+public:
+    VM* vm;
+    /// Number of characters of the whole rope
+    size_t length;
+    /// The two halves, each an ObjString, ObjRope or ObjSlice. Cleared once the rope is flattened.
+    Obj* left;
+    Obj* right;
+    /// The transient string with the characters of the rope, nullptr until the rope is flattened
+    ObjString* flat;
+    
+    /// Create a rope of two strings or ropes. Halves that were already flattened are replaced by their flat string,
+    /// so the ropes they were made of can be collected.
+    static ObjRope* newRope(VM* vm, Obj* left, Obj* right, size_t length);
+    
+    /// Append the characters of the rope to a buffer without flattening it
+    /// @param buffer The buffer to append to
+    void appendTo(std::string& buffer) const;
+    
+    /// Copy the characters of the rope into a transient string, the first time it is called
+    /// @return The transient string
+    ObjString* flatten();
+};
+
+/// A substring that shares the characters of its parent string instead of copying them.
+/// It is only copied into a string of its own when something needs an ObjString, like a native taking a string.
+class ObjSlice : public Obj {
+public:
+    VM* vm;
+    /// The string the characters belong to, cleared once the slice is materialized
+    ObjString* parent;
+    size_t offset;
+    size_t length;
+    /// Transient string with the characters of the slice, nullptr until the slice is materialized
+    ObjString* flat;
+    
+    /// Characters of the slice
+    std::string_view view() const { return flat != nullptr ? flat->view() : parent->view().substr(offset, length); }
+    
+    /// Take a substring of a string, rope or slice. The result is a slice sharing the characters of the string,
+    /// unless it would keep more than SLICE_RETAIN_LIMIT unused characters alive, in which case they are copied.
+    /// @param vm The virtual machine, the string must be reachable from its stack
+    /// @param string The string to take the substring of
+    /// @param offset Index of the first character, within the string
+    /// @param length Number of characters, within the string
+    /// @return The slice or string
+    static Value substring(VM* vm, Value string, size_t offset, size_t length);
+    
+    /// Copy the characters of the slice into a transient string, the first time it is called
+    /// @return The string
+    ObjString* materialize();
+};
+
 class ObjFunction : public Obj{
 public:
     int arity;
@@ -96,10 +185,20 @@ public:
     static ObjUpvalue* newUpvalue(Value* slot, VM* vm);
 };
 
+/// A variable captured by a closure: either shared with the enclosing function through an upvalue,
+/// or copied into the closure when it is never assigned.
+struct Capture {
+    /// The shared variable, nullptr if the variable was copied
+    ObjUpvalue* upvalue;
+    /// The copied variable
+    Value value;
+};
+
 class ObjClosure : public Obj {
 public:
     ObjFunction* function;
-    std::vector<ObjUpvalue*> upvalues;
+    /// Captured variables, stored in the same allocation right after the closure
+    Capture* upvalues;
     int upvalueCount;
     
     static ObjClosure* newClosure(ObjFunction* function, VM* vm);
@@ -182,6 +281,24 @@ public:
     NativeClassRes indexAssign(ObjNativeInstance* instance, int argCount, Value* args);
 };
 
+/// Native class that builds a string piece by piece in a growing buffer, which only becomes a transient string in toString
+class ObjStringBuilderClass : public ObjNativeClass {
+public:
+    using StringBuilderClassMethod = NativeClassRes(ObjStringBuilderClass::*)(ObjNativeInstance* instance, int argCount, Value* args);
+    
+    VM* vm;
+    
+    static ObjStringBuilderClass* newStringBuilderClass(ObjString* name, VM* vm);
+    NativeClassRes invokeMethod(ObjString* name, ObjNativeInstance* instance, int argCount, Value* args);
+    
+    NativeClassRes init(ObjNativeInstance* instance, int argCount, Value* args);
+    NativeClassRes append(ObjNativeInstance* instance, int argCount, Value* args);
+    NativeClassRes appendLine(ObjNativeInstance* instance, int argCount, Value* args);
+    NativeClassRes length(ObjNativeInstance* instance, int argCount, Value* args);
+    NativeClassRes clear(ObjNativeInstance* instance, int argCount, Value* args);
+    NativeClassRes toString(ObjNativeInstance* instance, int argCount, Value* args);
+};
+
 class ObjNativeInstance : public ObjInstance {
 public:
     NativeInstanceType subType;
@@ -197,4 +314,12 @@ public:
     static ObjCollectionInstance* newCollectionInstance(ObjCollectionClass* _class, VM* vm);
 };
 
+class ObjStringBuilderInstance : public ObjNativeInstance {
+public:
+    /// Characters appended so far
+    std::string buffer;
+    
+    static ObjStringBuilderInstance* newStringBuilderInstance(ObjStringBuilderClass* _class, VM* vm);
+};
+
 #endif /* object_h */
@@ -0,0 +1,933 @@
+#include "optimizer.hpp"
+#include "peephole.hpp"
+#include "flags.hpp"
+
+/// What the data flow analysis knows about a stack slot: nothing, or the instruction that pushes its constant value
+struct SlotValue {
+    bool known;
+    uint8_t op;
+    uint8_t operand;
+    
+    bool operator==(const SlotValue& other) const {
+        return known == other.known && (!known || (op == other.op && operand == other.operand));
+    }
+};
+
+static const SlotValue UNKNOWN = {false, 0, 0};
+
+/// Check if the instruction pushes a constant, and if so what the constant is
+static bool constantValue(const Instruction& instruction, Chunk* chunk, Value& value) {
+    switch(instruction.op) {
+        case OP_CONSTANT: value = chunk->constants.values[instruction.operands[0]]; return true;
+        case OP_NUL: value = ValueOP::nul_val(); return true;
+        case OP_TRUE: value = ValueOP::bool_val(true); return true;
+        case OP_FALSE: value = ValueOP::bool_val(false); return true;
+        
+        default:
+            return false;
+    }
+}
+
+/// Map the typed arithmetic instructions back to the generic instruction they specialize
+static uint8_t genericOp(uint8_t op) {
+    switch(op) {
+        case OP_ADD_INT: case OP_ADD_NUM: return OP_ADD;
+        case OP_SUBTRACT_INT: case OP_SUBTRACT_NUM: return OP_SUBTRACT;
+        case OP_MULTIPLY_INT: case OP_MULTIPLY_NUM: return OP_MULTIPLY;
+        case OP_DIVIDE_NUM: return OP_DIVIDE;
+        case OP_GREATER_INT: case OP_GREATER_NUM: return OP_GREATER;
+        case OP_LESS_INT: case OP_LESS_NUM: return OP_LESS;
+        
+        default:
+            return op;
+    }
+}
+
+std::vector<bool> Optimizer::capturedSlots(FunctionIR& function) {
+    std::vector<bool> captured(UINT8_MAX + 1, false);
+    
+    for(const Instruction& instruction : function.instructions) {
+        if(instruction.op != OP_CLOSURE) continue;
+        
+        //Operands are the function constant followed by an (isLocal, index) pair per upvalue
+        for(size_t i = 1; i + 1 < instruction.operands.size(); i += 2) {
+            if(instruction.operands[i]) captured[instruction.operands[i + 1]] = true;
+        }
+    }
+    
+    return captured;
+}
+
+bool Optimizer::propagateConstants(FunctionIR& function, const std::vector<bool>& captured) {
+    std::vector<Instruction>& instructions = function.instructions;
+    std::vector<std::vector<SlotValue>> entry(function.blocks.size());
+    std::vector<bool> visited(function.blocks.size(), false);
+    
+    auto transfer = [&](Instruction& instruction, std::vector<SlotValue>& stack, bool rewrite) -> bool {
+        bool changed = false;
+        
+        switch(instruction.op) {
+            case OP_CONSTANT:
+                stack.push_back({true, OP_CONSTANT, instruction.operands[0]});
+                return false;
+            case OP_NUL:
+            case OP_TRUE:
+            case OP_FALSE:
+                stack.push_back({true, instruction.op, 0});
+                return false;
+            case OP_DUP:
+                stack.push_back(stack.back());
+                return false;
+            case OP_GET_LOCAL: {
+                uint8_t slot = instruction.operands[0];
+                SlotValue value = slot < stack.size() && !captured[slot] ? stack[slot] : UNKNOWN;
+                
+                if(rewrite && value.known) {
+                    instruction.op = value.op;
+                    instruction.operands.clear();
+                    if(value.op == OP_CONSTANT) instruction.operands.push_back(value.operand);
+                    changed = true;
+                }
+                
+                stack.push_back(value);
+                return changed;
+            }
+            case OP_SET_LOCAL: {
+                uint8_t slot = instruction.operands[0];
+                if(slot < stack.size()) stack[slot] = captured[slot] ? UNKNOWN : stack.back();
+                return false;
+            }
+            
+            default: {
+                int pops, pushes;
+                FunctionIR::stackEffect(instruction, pops, pushes);
+                stack.resize(stack.size() - pops);
+                stack.resize(stack.size() + pushes, UNKNOWN);
+                return false;
+            }
+        }
+    };
+    
+    //Forward analysis, the state at a block entry is what all of its predecessors agree on
+    std::vector<size_t> worklist = {0};
+    entry[0].assign(function.heights[0], UNKNOWN);
+    visited[0] = true;
+    
+    while(!worklist.empty()) {
+        size_t index = worklist.back();
+        worklist.pop_back();
+        
+        const BasicBlock& block = function.blocks[index];
+        std::vector<SlotValue> stack = entry[index];
+        for(size_t i = block.begin; i < block.end; i++) transfer(instructions[i], stack, false);
+        
+        for(size_t successor : block.successors) {
+            if(!visited[successor]) {
+                visited[successor] = true;
+                entry[successor] = stack;
+                worklist.push_back(successor);
+                continue;
+            }
+            
+            bool narrowed = false;
+            for(size_t slot = 0; slot < stack.size(); slot++) {
+                if(entry[successor][slot].known && !(entry[successor][slot] == stack[slot])) {
+                    entry[successor][slot] = UNKNOWN;
+                    narrowed = true;
+                }
+            }
+            if(narrowed) worklist.push_back(successor);
+        }
+    }
+    
+    bool changed = false;
+    for(size_t index = 0; index < function.blocks.size(); index++) {
+        if(!visited[index]) continue;
+        
+        const BasicBlock& block = function.blocks[index];
+        std::vector<SlotValue> stack = entry[index];
+        for(size_t i = block.begin; i < block.end; i++) {
+            changed = transfer(instructions[i], stack, true) || changed;
+        }
+    }
+    
+    return foldConstants(function) || changed;
+}
+
+bool Optimizer::foldConstants(FunctionIR& function) {
+    std::vector<Instruction>& instructions = function.instructions;
+    Chunk* chunk = function.chunk;
+    std::unordered_set<size_t> labels = function.labels();
+    bool changed = false;
+    
+    //Indices of the last two instructions that were not removed
+    size_t first = SIZE_MAX;
+    size_t second = SIZE_MAX;
+    
+    for(size_t i = 0; i < instructions.size(); i++) {
+        Instruction& instruction = instructions[i];
+        if(instruction.removed) continue;
+        
+        Value a, b, result;
+        bool foldable = first != SIZE_MAX && !labels.count(instructions[second].offset) && !labels.count(instruction.offset) &&
+                        constantValue(instructions[first], chunk, a) && constantValue(instructions[second], chunk, b) &&
+                        chunk->constants.count < UINT8_MAX;
+        
+        if(foldable && instruction.op == OP_EQUAL) {
+            result = ValueOP::bool_val(ValueOP::valuesEqual(a, b));
+        } else if(foldable && ValueOP::is_number(a) && ValueOP::is_number(b)) {
+            Number x = ValueOP::as_number(a);
+            Number y = ValueOP::as_number(b);
+            
+            switch(genericOp(instruction.op)) {
+                case OP_ADD: result = ValueOP::number_val(x + y); break;
+                case OP_SUBTRACT: result = ValueOP::number_val(x - y); break;
+                case OP_MULTIPLY: result = ValueOP::number_val(x * y); break;
+                case OP_DIVIDE: result = ValueOP::number_val(x / y); break;
+                case OP_GREATER: result = ValueOP::bool_val(x > y); break;
+                case OP_LESS: result = ValueOP::bool_val(x < y); break;
+                
+                default:
+                    foldable = false;
+            }
+        } else {
+            foldable = false;
+        }
+        
+        if(!foldable) {
+            first = second;
+            second = i;
+            continue;
+        }
+        
+        //The folded constant takes the place of the operator, jumps to the operands relocate onto it
+        instructions[first].removed = true;
+        instructions[second].removed = true;
+        instruction.operands.clear();
+        if(ValueOP::is_bool(result)) {
+            instruction.op = ValueOP::as_bool(result) ? OP_TRUE : OP_FALSE;
+        } else {
+            instruction.op = OP_CONSTANT;
+            instruction.operands.push_back((uint8_t)chunk->addConstant(result));
+        }
+        changed = true;
+        
+        //The folded constant may be the operand of the next operator together with whatever came before it
+        second = i;
+        first = SIZE_MAX;
+        for(size_t k = i; k-- > 0;) {
+            if(!instructions[k].removed) {
+                first = k;
+                break;
+            }
+        }
+    }
+    
+    return changed;
+}
+
+bool Optimizer::eliminateDeadStores(FunctionIR& function, const std::vector<bool>& captured) {
+    std::vector<Instruction>& instructions = function.instructions;
+    std::vector<BasicBlock>& blocks = function.blocks;
+    
+    int maxHeight = 0;
+    for(int height : function.heights) maxHeight = std::max(maxHeight, height + 2);
+    
+    //Apply one instruction backwards to the set of live slots
+    auto transfer = [&](size_t i, std::vector<bool>& live) {
+        const Instruction& instruction = instructions[i];
+        int height = function.heights[i];
+        if(height < 0) return;
+        
+        int pops, pushes;
+        FunctionIR::stackEffect(instruction, pops, pushes);
+        
+        switch(instruction.op) {
+            case OP_POP:
+                live[height - 1] = false;
+                return;
+            case OP_GET_LOCAL:
+                live[height] = false;
+                live[instruction.operands[0]] = true;
+                return;
+            case OP_SET_LOCAL:
+                live[instruction.operands[0]] = false;
+                live[height - 1] = true;
+                return;
+            case OP_RETURN:
+                std::fill(live.begin(), live.end(), false);
+                live[height - 1] = true;
+                return;
+            
+            default:
+                for(int slot = height - pops; slot < height - pops + pushes; slot++) live[slot] = false;
+                for(int slot = height - pops; slot < height; slot++) live[slot] = true;
+        }
+    };
+    
+    std::vector<std::vector<bool>> liveIn(blocks.size(), std::vector<bool>(maxHeight, false));
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        
+        for(size_t index = blocks.size(); index-- > 0;) {
+            std::vector<bool> live(maxHeight, false);
+            for(size_t successor : blocks[index].successors) {
+                for(int slot = 0; slot < maxHeight; slot++) live[slot] = live[slot] || liveIn[successor][slot];
+            }
+            
+            for(size_t i = blocks[index].end; i-- > blocks[index].begin;) transfer(i, live);
+            
+            if(live != liveIn[index]) {
+                liveIn[index] = live;
+                changed = true;
+            }
+        }
+    }
+    
+    bool removed = false;
+    for(size_t index = 0; index < blocks.size(); index++) {
+        std::vector<bool> live(maxHeight, false);
+        for(size_t successor : blocks[index].successors) {
+            for(int slot = 0; slot < maxHeight; slot++) live[slot] = live[slot] || liveIn[successor][slot];
+        }
+        
+        for(size_t i = blocks[index].end; i-- > blocks[index].begin;) {
+            Instruction& instruction = instructions[i];
+            
+            //live holds the slots live after instruction i, the POP that follows a store is the next instruction
+            bool deadStore = instruction.op == OP_SET_LOCAL && i + 1 < blocks[index].end && instructions[i + 1].op == OP_POP &&
+                             function.heights[i] >= 0 && !captured[instruction.operands[0]] && !live[instruction.operands[0]];
+            
+            transfer(i, live);
+            
+            if(deadStore) {
+                instruction.removed = true;
+                removed = true;
+            }
+        }
+    }
+    
+    return removed;
+}
+
+/// Check if an instruction only computes a value from its operands, locals, upvalues or globals without changing anything
+static bool isPure(uint8_t op) {
+    switch(genericOp(op)) {
+        case OP_CONSTANT:
+        case OP_NUL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_GET_LOCAL:
+        case OP_GET_UPVALUE:
+        case OP_GET_GLOBAL:
+        case OP_NOT:
+        case OP_NEGATE:
+        case OP_ADD:
+        case OP_SUBTRACT:
+        case OP_MULTIPLY:
+        case OP_DIVIDE:
+        case OP_EQUAL:
+        case OP_GREATER:
+        case OP_LESS:
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+/// Check if an instruction fails unless its operands are numbers
+static bool isNumeric(uint8_t op) {
+    op = genericOp(op);
+    return op == OP_SUBTRACT || op == OP_MULTIPLY || op == OP_DIVIDE || op == OP_GREATER || op == OP_LESS || op == OP_NEGATE;
+}
+
+bool Optimizer::eliminateRepeats(FunctionIR& function) {
+    std::vector<Instruction>& instructions = function.instructions;
+    std::unordered_set<size_t> labels = function.labels();
+    bool changed = false;
+    
+    for(size_t i = 0; i < instructions.size(); i++) {
+        //Grow an expression from i, longest first wins
+        size_t best = 0;
+        bool hasAdd = false;
+        int depth = 0;
+        
+        for(size_t j = i; j < instructions.size(); j++) {
+            const Instruction& instruction = instructions[j];
+            if(instruction.removed || !isPure(instruction.op) || (j > i && labels.count(instruction.offset))) break;
+            
+            int pops, pushes;
+            FunctionIR::stackEffect(instruction, pops, pushes);
+            if(depth < pops) break;
+            depth += pushes - pops;
+            hasAdd = hasAdd || instruction.op == OP_ADD;
+            
+            size_t length = j - i + 1;
+            if(depth != 1 || j + length + 1 >= instructions.size()) continue;
+            
+            bool same = true;
+            for(size_t k = 0; k < length && same; k++) {
+                const Instruction& repeat = instructions[j + 1 + k];
+                same = !repeat.removed && !labels.count(repeat.offset) &&
+                       repeat.op == instructions[i + k].op && repeat.operands == instructions[i + k].operands;
+            }
+            
+            //Adding two collections makes a new collection each time, so only share a sum that must be a number
+            if(same && hasAdd) same = isNumeric(instructions[j + 1 + length].op);
+            if(same) best = length;
+        }
+        
+        if(best == 0) continue;
+        
+        Instruction& duplicate = instructions[i + best];
+        duplicate.op = OP_DUP;
+        duplicate.operands.clear();
+        for(size_t k = 1; k < best; k++) instructions[i + best + k].removed = true;
+        
+        changed = true;
+        i += 2 * best - 1;
+    }
+    
+    return changed;
+}
+
+/// A value on the stack that a pure expression computed within the current basic block
+struct Expression {
+    bool known;
+    /// The instructions of the expression in order, each as its opcode followed by its operands
+    std::string key;
+    /// Index of the first instruction of the expression
+    size_t start;
+    bool hasAdd;
+};
+
+bool Optimizer::eliminateCommonSubexpressions(FunctionIR& function) {
+    std::vector<Instruction>& instructions = function.instructions;
+    bool changed = false;
+    
+    for(const BasicBlock& block : function.blocks) {
+        if(function.heights[block.begin] < 0) continue;
+        
+        //What each stack slot holds, counted from the frame's first slot. Nothing is known when the block is entered.
+        std::vector<Expression> slots(function.heights[block.begin], Expression{false, "", 0, false});
+        
+        for(size_t i = block.begin; i < block.end; i++) {
+            Instruction& instruction = instructions[i];
+            
+            int pops, pushes;
+            if(!FunctionIR::stackEffect(instruction, pops, pushes) || (int)slots.size() < pops) break;
+            size_t base = slots.size() - pops;
+            
+            if(instruction.op == OP_DUP) {
+                Expression copy = slots.back();
+                copy.start = i;
+                slots.push_back(copy);
+                continue;
+            }
+            
+            if(!isPure(instruction.op)) {
+                //Anything else may write a local, a global or an upvalue, or call code that does
+                if(instruction.op != OP_POP) {
+                    for(Expression& slot : slots) slot.known = false;
+                }
+                slots.resize(base);
+                slots.resize(base + pushes, Expression{false, "", 0, false});
+                continue;
+            }
+            
+            Expression result{true, "", pops > 0 ? slots[base].start : i, instruction.op == OP_ADD};
+            for(size_t k = base; k < slots.size(); k++) {
+                result.known = result.known && slots[k].known;
+                result.key += slots[k].key;
+                result.hasAdd = result.hasAdd || slots[k].hasAdd;
+            }
+            result.key += (char)instruction.op;
+            result.key.append(instruction.operands.begin(), instruction.operands.end());
+            slots.resize(base);
+            
+            //The expression must span more than one instruction, all of them pure, to be worth replacing
+            bool replaceable = result.known && result.start < i;
+            for(size_t k = result.start; k < i && replaceable; k++) {
+                replaceable = instructions[k].removed || isPure(instructions[k].op) || instructions[k].op == OP_DUP;
+            }
+            
+            //Adding two collections makes a new collection each time, so only share a sum that must be a number
+            if(replaceable && result.hasAdd) replaceable = i + 1 < block.end && isNumeric(instructions[i + 1].op);
+            
+            //Reuse the closest slot still holding the same value, the expression pushes its result at base
+            size_t match = base;
+            for(size_t slot = std::min(base, (size_t)UINT8_MAX + 1); replaceable && slot-- > 0;) {
+                if(slots[slot].known && slots[slot].key == result.key) {
+                    match = slot;
+                    break;
+                }
+            }
+            
+            if(match != base) {
+                for(size_t k = result.start; k < i; k++) instructions[k].removed = true;
+                
+                if(match == base - 1) {
+                    instruction.op = OP_DUP;
+                    instruction.operands.clear();
+                } else {
+                    instruction.op = OP_GET_LOCAL;
+                    instruction.operands = {(uint8_t)match};
+                }
+                result.start = i;
+                changed = true;
+            }
+            
+            slots.push_back(result);
+        }
+    }
+    
+    return changed;
+}
+
+/// What the type inference knows about a stack slot, from most to least precise.
+/// Whole numbers become floats when arithmetic on them overflows, so KIND_WHOLE is only what is expected.
+enum NumberKind {
+    KIND_WHOLE,
+    KIND_FLOAT,
+    KIND_NUMBER,
+    KIND_UNKNOWN,
+};
+
+/// The kind of a slot that holds either of two kinds depending on the path taken
+static NumberKind join(NumberKind a, NumberKind b) {
+    if(a == b) return a;
+    if(a == KIND_UNKNOWN || b == KIND_UNKNOWN) return KIND_UNKNOWN;
+    return KIND_NUMBER;
+}
+
+bool Optimizer::inferTypes(FunctionIR& function, const std::vector<bool>& captured) {
+    std::vector<Instruction>& instructions = function.instructions;
+    std::vector<std::vector<NumberKind>> entry(function.blocks.size());
+    std::vector<bool> visited(function.blocks.size(), false);
+    
+    auto transfer = [&](Instruction& instruction, std::vector<NumberKind>& stack, bool rewrite) -> bool {
+        switch(genericOp(instruction.op)) {
+            case OP_CONSTANT: {
+                Value value = function.chunk->constants.values[instruction.operands[0]];
+                NumberKind kind = KIND_UNKNOWN;
+                if(ValueOP::is_number(value)) kind = ValueOP::as_number(value).is_float ? KIND_FLOAT : KIND_WHOLE;
+                stack.push_back(kind);
+                return false;
+            }
+            case OP_DUP:
+                stack.push_back(stack.back());
+                return false;
+            case OP_GET_LOCAL: {
+                uint8_t slot = instruction.operands[0];
+                stack.push_back(slot < stack.size() && !captured[slot] ? stack[slot] : KIND_UNKNOWN);
+                return false;
+            }
+            case OP_SET_LOCAL: {
+                uint8_t slot = instruction.operands[0];
+                if(slot < stack.size()) stack[slot] = captured[slot] ? KIND_UNKNOWN : stack.back();
+                return false;
+            }
+            case OP_NEGATE:
+                //Negation keeps the kind of a number and fails on anything else
+                return false;
+            case OP_BIT_NOT:
+                //Bitwise operators fail on anything but whole numbers, so whatever they produce is one
+                stack.back() = KIND_WHOLE;
+                return false;
+            case OP_BIT_AND:
+            case OP_BIT_OR:
+            case OP_BIT_XOR:
+            case OP_SHIFT_LEFT:
+            case OP_SHIFT_RIGHT:
+            case OP_SHIFT_RIGHT_UNSIGNED:
+                stack.pop_back();
+                stack.back() = KIND_WHOLE;
+                return false;
+            case OP_INLINE_GUARD:
+                return false;
+            case OP_SLIDE: {
+                NumberKind top = stack.back();
+                stack.resize(stack.size() - instruction.operands[0]);
+                stack.back() = top;
+                return false;
+            }
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_GREATER:
+            case OP_LESS: {
+                uint8_t op = genericOp(instruction.op);
+                NumberKind b = stack.back();
+                stack.pop_back();
+                NumberKind a = stack.back();
+                bool whole = a == KIND_WHOLE && b == KIND_WHOLE;
+                bool numbers = a != KIND_UNKNOWN && b != KIND_UNKNOWN;
+                
+                if(op == OP_GREATER || op == OP_LESS) stack.back() = KIND_UNKNOWN;
+                else if(!numbers) stack.back() = KIND_UNKNOWN;
+                else if(op == OP_DIVIDE || a == KIND_FLOAT || b == KIND_FLOAT) stack.back() = KIND_FLOAT;
+                else stack.back() = whole ? KIND_WHOLE : KIND_NUMBER;
+                
+                if(!rewrite || !numbers) return false;
+                
+                uint8_t typed = op;
+                switch(op) {
+                    case OP_ADD: typed = whole ? OP_ADD_INT : OP_ADD_NUM; break;
+                    case OP_SUBTRACT: typed = whole ? OP_SUBTRACT_INT : OP_SUBTRACT_NUM; break;
+                    case OP_MULTIPLY: typed = whole ? OP_MULTIPLY_INT : OP_MULTIPLY_NUM; break;
+                    case OP_DIVIDE: typed = OP_DIVIDE_NUM; break;
+                    case OP_GREATER: typed = whole ? OP_GREATER_INT : OP_GREATER_NUM; break;
+                    case OP_LESS: typed = whole ? OP_LESS_INT : OP_LESS_NUM; break;
+                }
+                
+                if(typed == instruction.op) return false;
+                instruction.op = typed;
+                return true;
+            }
+            
+            default: {
+                int pops, pushes;
+                FunctionIR::stackEffect(instruction, pops, pushes);
+                stack.resize(stack.size() - pops);
+                stack.resize(stack.size() + pushes, KIND_UNKNOWN);
+                return false;
+            }
+        }
+    };
+    
+    //Forward analysis like propagateConstants, a slot only keeps a kind that every path into the block agrees with
+    std::vector<size_t> worklist = {0};
+    entry[0].assign(function.heights[0], KIND_UNKNOWN);
+    visited[0] = true;
+    
+    while(!worklist.empty()) {
+        size_t index = worklist.back();
+        worklist.pop_back();
+        
+        const BasicBlock& block = function.blocks[index];
+        std::vector<NumberKind> stack = entry[index];
+        for(size_t i = block.begin; i < block.end; i++) {
+            if(!instructions[i].removed) transfer(instructions[i], stack, false);
+        }
+        
+        for(size_t successor : block.successors) {
+            if(!visited[successor]) {
+                visited[successor] = true;
+                entry[successor] = stack;
+                worklist.push_back(successor);
+                continue;
+            }
+            
+            bool widened = false;
+            for(size_t slot = 0; slot < stack.size(); slot++) {
+                NumberKind kind = join(entry[successor][slot], stack[slot]);
+                if(kind != entry[successor][slot]) {
+                    entry[successor][slot] = kind;
+                    widened = true;
+                }
+            }
+            if(widened) worklist.push_back(successor);
+        }
+    }
+    
+    bool changed = false;
+    for(size_t index = 0; index < function.blocks.size(); index++) {
+        if(!visited[index]) continue;
+        
+        const BasicBlock& block = function.blocks[index];
+        std::vector<NumberKind> stack = entry[index];
+        for(size_t i = block.begin; i < block.end; i++) {
+            if(!instructions[i].removed) changed = transfer(instructions[i], stack, true) || changed;
+        }
+    }
+    
+    return changed;
+}
+
+void Optimizer::optimize(ObjFunction* function) {
+    if(OPTIMIZATION_LEVEL >= 2) {
+        FunctionIR ir(&function->chunk);
+        std::vector<bool> captured = capturedSlots(ir);
+        
+        //Default parameters are filled in by code at the top of the function, which leaves the entry height unknown
+        bool heightsKnown = function->defaults == 0 && ir.computeHeights(1 + function->arity);
+        
+        bool changed = false;
+        if(heightsKnown) {
+            changed = propagateConstants(ir, captured) || changed;
+            changed = eliminateDeadStores(ir, captured) || changed;
+        } else {
+            changed = eliminateRepeats(ir);
+        }
+        
+        if(changed) ir.lower();
+        
+        //Common subexpressions and then types are found on the code the other passes simplified, from a fresh graph of it
+        if(heightsKnown) {
+            FunctionIR shared(&function->chunk);
+            if(shared.computeHeights(1 + function->arity) && eliminateCommonSubexpressions(shared)) shared.lower();
+            
+            FunctionIR typed(&function->chunk);
+            if(typed.computeHeights(1 + function->arity) && inferTypes(typed, captured)) typed.lower();
+        }
+    }
+    
+    if(OPTIMIZATION_LEVEL >= 1) Peephole::optimize(&function->chunk);
+}
+
+void Optimizer::collectFunctions(ObjFunction* function, std::vector<ObjFunction*>& functions,
+                                 std::unordered_map<uint8_t, ObjFunction*>& globals) {
+    if(std::find(functions.begin(), functions.end(), function) != functions.end()) return;
+    functions.push_back(function);
+    
+    Chunk* chunk = &function->chunk;
+    for(size_t i = 0; i < chunk->constants.count; i++) {
+        if(ValueOP::is_function(chunk->constants.values[i])) {
+            collectFunctions(ValueOP::as_function(chunk->constants.values[i]), functions, globals);
+        }
+    }
+    
+    //A function without upvalues is loaded as a constant and then bound to its global
+    FunctionIR ir(chunk);
+    for(size_t i = 0; i + 1 < ir.instructions.size(); i++) {
+        if(ir.instructions[i].op != OP_CONSTANT || ir.instructions[i + 1].op != OP_DEFINE_GLOBAL) continue;
+        
+        Value value = chunk->constants.values[ir.instructions[i].operands[0]];
+        if(!ValueOP::is_function(value)) continue;
+        
+        uint8_t global = ir.instructions[i + 1].operands[0];
+        auto bound = globals.find(global);
+        if(bound == globals.end()) {
+            globals[global] = ValueOP::as_function(value);
+        } else if(bound->second != ValueOP::as_function(value)) {
+            bound->second = nullptr;
+        }
+    }
+}
+
+bool Optimizer::isInlinable(ObjFunction* function) {
+    if(function->funcType != TYPE_FUNCTION || function->upvalueCount > 0 || function->defaults > 0 ||
+       function->chunk.count > MAX_INLINE_SIZE) return false;
+    
+    //Leaf functions only, so the copy never needs a frame of its own and is never recursive
+    FunctionIR ir(&function->chunk);
+    for(const Instruction& instruction : ir.instructions) {
+        switch(genericOp(instruction.op)) {
+            case OP_CONSTANT:
+            case OP_NUL:
+            case OP_TRUE:
+            case OP_FALSE:
+            case OP_POP:
+            case OP_DUP:
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+            case OP_GET_GLOBAL:
+            case OP_SET_GLOBAL:
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY:
+            case OP_NOT:
+            case OP_NEGATE:
+            case OP_ADD:
+            case OP_SUBTRACT:
+            case OP_MULTIPLY:
+            case OP_DIVIDE:
+            case OP_EQUAL:
+            case OP_GREATER:
+            case OP_LESS:
+            case OP_MODULO:
+            case OP_INT_DIVIDE:
+            case OP_BIT_AND:
+            case OP_BIT_OR:
+            case OP_BIT_XOR:
+            case OP_BIT_NOT:
+            case OP_SHIFT_LEFT:
+            case OP_SHIFT_RIGHT:
+            case OP_SHIFT_RIGHT_UNSIGNED:
+            case OP_CONDITIONAL:
+            case OP_PRINT:
+            case OP_JUMP:
+            case OP_JUMP_IF_FALSE:
+            case OP_JUMP_IF_TRUE:
+            case OP_RETURN:
+                break;
+                
+            default:
+                return false;
+        }
+    }
+    
+    return true;
+}
+
+/// Find a constant in the chunk or add it, as long as its index fits in one byte
+/// @return The index of the constant, or -1 if there are too many constants
+static int constantIndex(Chunk* chunk, Value value) {
+    for(size_t i = 0; i < chunk->constants.count && i <= UINT8_MAX; i++) {
+        const Value& constant = chunk->constants.values[i];
+        if(constant.type == value.type && ValueOP::valuesEqual(constant, value)) return (int)i;
+    }
+    
+    if(chunk->constants.count > UINT8_MAX) return -1;
+    return chunk->addConstant(value);
+}
+
+bool Optimizer::inlineCall(FunctionIR& caller, const Instruction& call, int base, ObjFunction* callee,
+                           std::vector<Instruction>& code, std::vector<Instruction>& outOfLine, size_t& nextOffset) {
+    FunctionIR body(&callee->chunk);
+    if(!body.computeHeights(1 + callee->arity)) return false;
+    
+    Chunk* chunk = caller.chunk;
+    size_t constantCount = chunk->constants.count;
+    int calleeConstant = constantIndex(chunk, ValueOP::obj_val(callee));
+    
+    //Inserted instructions get offsets past the end of the chunk, the guard takes the place of the call
+    std::unordered_map<size_t, size_t> offsets;
+    for(const Instruction& instruction : body.instructions) offsets[instruction.offset] = nextOffset++;
+    size_t slowPath = nextOffset++;
+    size_t end = call.offset + call.length();
+    
+    std::vector<Instruction> copy;
+    copy.push_back(Instruction{call.offset, OP_INLINE_GUARD, {call.operands[0], (uint8_t)calleeConstant}, slowPath, call.line, false});
+    
+    bool fits = calleeConstant != -1;
+    for(size_t i = 0; i < body.instructions.size() && fits; i++) {
+        Instruction instruction = body.instructions[i];
+        int height = body.heights[i];
+        if(height < 0) continue;
+        
+        instruction.offset = offsets[instruction.offset];
+        if(FunctionIR::isJump(instruction.op)) instruction.target = offsets[instruction.target];
+        
+        //Copied instructions keep the callee's lines, tagged so runtime errors still show the callee's frame
+        instruction.inlinedFrom = callee;
+        instruction.callLine = call.line;
+        
+        switch(instruction.op) {
+            case OP_GET_LOCAL:
+            case OP_SET_LOCAL:
+                fits = base + instruction.operands[0] <= UINT8_MAX;
+                instruction.operands[0] += base;
+                break;
+            case OP_CONSTANT:
+            case OP_GET_PROPERTY:
+            case OP_SET_PROPERTY: {
+                int constant = constantIndex(chunk, callee->chunk.constants.values[instruction.operands[0]]);
+                fits = constant != -1;
+                instruction.operands[0] = (uint8_t)constant;
+                break;
+            }
+            case OP_RETURN:
+                //Leave the result in the callee slot, like a return would
+                fits = height - 1 <= UINT8_MAX;
+                instruction.op = OP_SLIDE;
+                instruction.operands = {(uint8_t)(height - 1)};
+                copy.push_back(instruction);
+                instruction = Instruction{nextOffset++, OP_JUMP, {}, end, instruction.line, false, callee, call.line};
+                break;
+        }
+        
+        copy.push_back(instruction);
+    }
+    
+    if(!fits) {
+        chunk->constants.values.resize(constantCount);
+        chunk->constants.count = constantCount;
+        return false;
+    }
+    
+    //The last return falls through to the code after the call, its jump is dropped by the peephole pass
+    Instruction slowCall = call;
+    slowCall.offset = slowPath;
+    outOfLine.push_back(slowCall);
+    outOfLine.push_back(Instruction{nextOffset++, OP_LOOP, {}, end, call.line, false});
+    
+    code.insert(code.end(), copy.begin(), copy.end());
+    return true;
+}
+
+bool Optimizer::inlineCalls(ObjFunction* function, const std::unordered_map<uint8_t, ObjFunction*>& globals) {
+    if(function->defaults > 0) return false;
+    
+    FunctionIR ir(&function->chunk);
+    if(!ir.computeHeights(1 + function->arity)) return false;
+    
+    size_t constantCount = function->chunk.constants.count;
+    std::vector<Instruction> code;
+    std::vector<Instruction> outOfLine;
+    size_t nextOffset = function->chunk.count + 1;
+    bool changed = false;
+    
+    for(const BasicBlock& block : ir.blocks) {
+        int entry = ir.heights[block.begin];
+        
+        //Index of the instruction that pushed each stack slot, when it is known within the block
+        std::vector<size_t> pushers(std::max(entry, 0), SIZE_MAX);
+        
+        for(size_t i = block.begin; i < block.end; i++) {
+            const Instruction& instruction = ir.instructions[i];
+            
+            int pops, pushes;
+            FunctionIR::stackEffect(instruction, pops, pushes);
+            
+            bool inlined = false;
+            if(entry >= 0 && instruction.op == OP_CALL) {
+                int base = (int)pushers.size() - instruction.operands[0] - 1;
+                size_t pusher = pushers[base];
+                
+                if(pusher != SIZE_MAX && ir.instructions[pusher].op == OP_GET_GLOBAL) {
+                    auto callee = globals.find(ir.instructions[pusher].operands[0]);
+                    inlined = callee != globals.end() && callee->second != nullptr &&
+                              callee->second->arity == instruction.operands[0] && isInlinable(callee->second) &&
+                              inlineCall(ir, instruction, base, callee->second, code, outOfLine, nextOffset);
+                }
+            }
+            
+            if(inlined) {
+                changed = true;
+            } else {
+                code.push_back(instruction);
+            }
+            
+            if(entry < 0) continue;
+            size_t top = pushers.empty() ? SIZE_MAX : pushers.back();
+            pushers.resize(pushers.size() - pops);
+            
+            if(instruction.op == OP_DUP) {
+                pushers.push_back(top);
+                pushers.push_back(top);
+            } else if(instruction.op == OP_GET_GLOBAL) {
+                pushers.push_back(i);
+            } else {
+                pushers.resize(pushers.size() + pushes, SIZE_MAX);
+            }
+        }
+    }
+    
+    if(!changed) return false;
+    
+    code.insert(code.end(), outOfLine.begin(), outOfLine.end());
+    ir.instructions = std::move(code);
+    
+    //The copies can push jumps of a large function out of range, it then keeps its calls
+    if(!ir.lower()) {
+        function->chunk.constants.values.resize(constantCount);
+        function->chunk.constants.count = constantCount;
+        return false;
+    }
+    return true;
+}
+
+void Optimizer::optimizeProgram(ObjFunction* script) {
+    if(OPTIMIZATION_LEVEL < 2) return;
+    
+    std::vector<ObjFunction*> functions;
+    std::unordered_map<uint8_t, ObjFunction*> globals;
+    collectFunctions(script, functions, globals);
+    
+    for(ObjFunction* function : functions) {
+        if(inlineCalls(function, globals)) optimize(function);
+    }
+}
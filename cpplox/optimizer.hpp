@@ -0,0 +1,85 @@
+#ifndef optimizer_hpp
+#define optimizer_hpp
+
+#include "pch.pch"
+#include "ir.hpp"
+#include "object.hpp"
+
+/// Optimization pipeline run on every function the compiler finishes, selected by OPTIMIZATION_LEVEL (-O on the command line).
+///
+/// Level 0 emits the bytecode exactly as parsed. Level 1, the default, folds constant expressions while parsing
+/// and runs the peephole pass. Level 2 also lifts each function into a FunctionIR and runs data flow passes over its
+/// control flow graph before the peephole pass, and inlines small functions once the whole program is compiled.
+class Optimizer {
+    
+    /// Collect the local slots captured by closures created in the function. Inner functions can write them at any time,
+    /// so the data flow passes leave them alone.
+    static std::vector<bool> capturedSlots(FunctionIR& function);
+    
+    /// Replace reads of locals that hold a known constant on every path with the constant itself,
+    /// then fold arithmetic on constants that became adjacent.
+    /// @return Whether or not anything was changed
+    static bool propagateConstants(FunctionIR& function, const std::vector<bool>& captured);
+    
+    /// Fold an arithmetic or comparison instruction whose two operands are constant pushes right before it.
+    /// @return Whether or not anything was changed
+    static bool foldConstants(FunctionIR& function);
+    
+    /// Remove stores to locals that are popped right away and never read again before being overwritten.
+    /// @return Whether or not anything was changed
+    static bool eliminateDeadStores(FunctionIR& function, const std::vector<bool>& captured);
+    
+    /// Replace a pure expression that is computed twice in a row, as in (a + b) * (a + b), with OP_DUP.
+    /// Used instead of eliminateCommonSubexpressions when the stack heights are not known.
+    /// @return Whether or not anything was changed
+    static bool eliminateRepeats(FunctionIR& function);
+    
+    /// Replace a pure expression whose value an earlier expression in the same basic block left on the stack,
+    /// as the second a * b in var x = a * b; print x + a * b;, with OP_DUP when the value is on top or OP_GET_LOCAL of its slot.
+    /// Any instruction that can write a variable or call code forgets every value computed before it. Needs the stack heights.
+    /// @return Whether or not anything was changed
+    static bool eliminateCommonSubexpressions(FunctionIR& function);
+    
+    /// Find the arithmetic and comparison instructions whose operands are numbers on every path, or whole numbers
+    /// barring overflow, and replace them with typed instructions that skip the checks the generic ones make.
+    /// @return Whether or not anything was changed
+    static bool inferTypes(FunctionIR& function, const std::vector<bool>& captured);
+    
+    /// Collect every function of a program, and the function each global function declaration binds.
+    /// Globals declared with different functions are mapped to nullptr.
+    static void collectFunctions(ObjFunction* function, std::vector<ObjFunction*>& functions,
+                                 std::unordered_map<uint8_t, ObjFunction*>& globals);
+    
+    /// Check if a function is a small leaf function that can be copied into its callers
+    static bool isInlinable(ObjFunction* function);
+    
+    /// Copy the body of a callee in place of the call instruction, behind a guard that checks the callee is
+    /// still the same function. The call itself moves out of line, for when the guard fails.
+    /// @param caller The calling function
+    /// @param call The call instruction
+    /// @param base Stack slot of the callee, which becomes slot 0 of the copied body
+    /// @param callee The function to copy
+    /// @param code Instructions the copy is appended to
+    /// @param outOfLine Instructions the call is appended to, which go after the end of the function
+    /// @param nextOffset Next unused offset for inserted instructions
+    /// @return false if the callee does not fit into the caller, in which case nothing was appended
+    static bool inlineCall(FunctionIR& caller, const Instruction& call, int base, ObjFunction* callee,
+                           std::vector<Instruction>& code, std::vector<Instruction>& outOfLine, size_t& nextOffset);
+    
+    /// Inline the calls of a function to small global functions.
+    /// @return Whether or not anything was changed
+    static bool inlineCalls(ObjFunction* function, const std::unordered_map<uint8_t, ObjFunction*>& globals);
+    
+public:
+    
+    /// Optimize a function the compiler just finished.
+    /// @param function The function to optimize
+    static void optimize(ObjFunction* function);
+    
+    /// Inline small global functions into every function of a finished program, which is only possible once all of
+    /// them are compiled, and optimize the functions that changed again.
+    /// @param script The top level function of the program
+    static void optimizeProgram(ObjFunction* script);
+};
+
+#endif /* optimizer_hpp */
@@ -0,0 +1,105 @@
+#include "peephole.hpp"
+
+bool Peephole::isPurePush(uint8_t op) {
+    switch(op) {
+        case OP_CONSTANT:
+        case OP_CONSTANT_LONG:
+        case OP_NUL:
+        case OP_TRUE:
+        case OP_FALSE:
+        case OP_DUP:
+        case OP_GET_LOCAL:
+        case OP_GET_UPVALUE:
+            return true;
+        
+        default:
+            return false;
+    }
+}
+
+bool Peephole::rewrite(FunctionIR& function) {
+    bool changed = false;
+    std::vector<Instruction>& instructions = function.instructions;
+    std::unordered_map<size_t, size_t>& indexOf = function.indexOf;
+    
+    //Thread jumps that land on an unconditional jump straight to the final target
+    for(Instruction& instruction : instructions) {
+        if(!FunctionIR::isJump(instruction.op)) continue;
+        
+        size_t target = instruction.target;
+        for(size_t hops = 0; hops < instructions.size(); hops++) {
+            auto next = indexOf.find(target);
+            if(next == indexOf.end()) break;
+            
+            const Instruction& landing = instructions[next->second];
+            if(landing.op != OP_JUMP && landing.op != OP_LOOP) break;
+            if(landing.target == target) break;
+            target = landing.target;
+        }
+        
+        if(target == instruction.target) continue;
+        
+        //Conditional jumps can only go forward, an unconditional one becomes OP_LOOP when it has to go back
+        if(instruction.op == OP_JUMP || instruction.op == OP_LOOP) {
+            instruction.op = target > instruction.offset ? OP_JUMP : OP_LOOP;
+        } else if(target <= instruction.offset) {
+            continue;
+        }
+        
+        instruction.target = target;
+        changed = true;
+    }
+    
+    std::unordered_set<size_t> labels = function.labels();
+    
+    for(size_t i = 0; i < instructions.size(); i++) {
+        Instruction& instruction = instructions[i];
+        if(instruction.removed) continue;
+        
+        //A jump to the next instruction does nothing
+        if(instruction.op == OP_JUMP && instruction.target == instruction.offset + instruction.length()) {
+            instruction.removed = true;
+            changed = true;
+            continue;
+        }
+        
+        //Nothing after a return or an unconditional jump runs until something jumps back in
+        if(instruction.op == OP_RETURN || instruction.op == OP_JUMP || instruction.op == OP_LOOP || instruction.op == OP_SWITCH_TABLE) {
+            for(size_t k = i + 1; k < instructions.size() && !labels.count(instructions[k].offset); k++) {
+                if(!instructions[k].removed) changed = true;
+                instructions[k].removed = true;
+            }
+            continue;
+        }
+        
+        if(i + 1 >= instructions.size()) continue;
+        Instruction& next = instructions[i + 1];
+        if(next.removed || labels.count(next.offset)) continue;
+        
+        if(isPurePush(instruction.op) && next.op == OP_POP) {
+            instruction.removed = true;
+            next.removed = true;
+            changed = true;
+            continue;
+        }
+        
+        //OP_JUMP_IF_FALSE leaves the condition on the stack. The fused jump leaves the condition before OP_NOT
+        //instead, which is only correct when both paths pop it right away.
+        if(instruction.op == OP_NOT && next.op == OP_JUMP_IF_FALSE && i + 2 < instructions.size() &&
+           instructions[i + 2].op == OP_POP && indexOf.count(next.target) &&
+           instructions[indexOf[next.target]].op == OP_POP) {
+            instruction.removed = true;
+            next.op = OP_JUMP_IF_TRUE;
+            changed = true;
+        }
+    }
+    
+    return changed;
+}
+
+void Peephole::optimize(Chunk* chunk) {
+    for(;;) {
+        FunctionIR function(chunk);
+        if(!rewrite(function) || !function.lower()) return;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef peephole_hpp
+#define peephole_hpp
+
+#include "pch.pch"
+#include "chunk.hpp"
+#include "ir.hpp"
+
+/// Peephole optimizer that rewrites a finished chunk in place.
+///
+/// The chunk is lifted into a FunctionIR, short patterns are rewritten or deleted, and the function is lowered again,
+/// which relocates every jump and the line table.
+class Peephole {
+    
+    /// Check if the instruction only pushes a value without any other effect, so pushing and popping it again does nothing.
+    /// @param op The instruction
+    static bool isPurePush(uint8_t op);
+    
+    /// Run every pattern once over the instructions of the function.
+    /// @return Whether or not anything was changed
+    static bool rewrite(FunctionIR& function);
+    
+public:
+    
+    /// Optimize the chunk until no pattern applies anymore.
+    /// Threads chains of jumps, drops jumps to the next instruction, removes code after OP_RETURN and unconditional
+    /// jumps that nothing jumps into, deletes values that are pushed and immediately popped,
+    /// and fuses OP_NOT followed by OP_JUMP_IF_FALSE into OP_JUMP_IF_TRUE.
+    /// @param chunk The chunk to optimize
+    static void optimize(Chunk* chunk);
+};
+
+#endif /* peephole_hpp */
@@ -1,7 +1,182 @@
 #include "scanner.hpp"
+#include <mutex>
+#include <array>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCANNER_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCANNER_SIMD
+#endif
 
-Token::Token(TokenType type, const std::string& source, int start, size_t length, int line) {
+//Runs of whitespace, comment bodies, identifiers and string bodies are skipped a whole block of bytes at a time.
+//Each character class compares a block against its members and the first byte outside the class is found
+//from the resulting bit mask. Bytes at the end of the source that do not fill a block are checked one by one.
+#if defined(__AVX2__)
+typedef __m256i Block;
+static const size_t BLOCK_SIZE = 32;
+static const uint32_t BLOCK_MASK = 0xFFFFFFFF;
+
+static inline Block loadBlock(const char* at) { return _mm256_loadu_si256((const __m256i*)at); }
+static inline Block isByte(Block block, char c) { return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(c)); }
+static inline Block either(Block a, Block b) { return _mm256_or_si256(a, b); }
+static inline uint32_t toMask(Block block) { return (uint32_t)_mm256_movemask_epi8(block); }
+
+//Bytes are compared as signed, which is correct as long as both bounds are ASCII
+static inline Block inRange(Block block, char low, char high) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(block, _mm256_set1_epi8(low - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), block));
+}
+#elif defined(__SSE2__)
+typedef __m128i Block;
+static const size_t BLOCK_SIZE = 16;
+static const uint32_t BLOCK_MASK = 0xFFFF;
+
+static inline Block loadBlock(const char* at) { return _mm_loadu_si128((const __m128i*)at); }
+static inline Block isByte(Block block, char c) { return _mm_cmpeq_epi8(block, _mm_set1_epi8(c)); }
+static inline Block either(Block a, Block b) { return _mm_or_si128(a, b); }
+static inline uint32_t toMask(Block block) { return (uint32_t)_mm_movemask_epi8(block); }
+
+//Bytes are compared as signed, which is correct as long as both bounds are ASCII
+static inline Block inRange(Block block, char low, char high) {
+    return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(low - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), block));
+}
+#endif
+
+//Each character class tells whether a single character belongs to it and, for a whole block,
+//returns a bit mask of the bytes that do not belong to it.
+struct Blank {
+    static bool contains(char c) { return c == ' ' || c == '\r' || c == '\t' || c == '\n'; }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) {
+        return ~toMask(either(either(isByte(b, ' '), isByte(b, '\r')), either(isByte(b, '\t'), isByte(b, '\n')))) & BLOCK_MASK;
+    }
+#endif
+};
+
+struct CommentBody {
+    static bool contains(char c) { return c != '\n'; }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) { return toMask(isByte(b, '\n')); }
+#endif
+};
+
+struct StringBody {
+    static bool contains(char c) { return c != '"'; }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) { return toMask(isByte(b, '"')); }
+#endif
+};
+
+struct TemplateBody {
+    static bool contains(char c) { return c != '`' && c != '$'; }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) { return toMask(either(isByte(b, '`'), isByte(b, '$'))); }
+#endif
+};
+
+struct Digit {
+    static bool contains(char c) { return c >= '0' && c <= '9'; }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) { return ~toMask(inRange(b, '0', '9')) & BLOCK_MASK; }
+#endif
+};
+
+struct IdentifierChar {
+    static bool contains(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+#ifdef SCANNER_SIMD
+    static uint32_t outside(Block b) {
+        Block letters = either(inRange(b, 'a', 'z'), inRange(b, 'A', 'Z'));
+        return ~toMask(either(letters, either(inRange(b, '0', '9'), isByte(b, '_')))) & BLOCK_MASK;
+    }
+#endif
+};
+
+/// Return the position of the first character at or after pos that is not in the character class.
+/// @param source Scanned source
+/// @param pos Position to start from
+template<typename Class>
+static size_t skipWhile(const std::string& source, size_t pos) {
+    const char* text = source.data();
+    size_t end = source.length();
+    
+#ifdef SCANNER_SIMD
+    while(pos + BLOCK_SIZE <= end) {
+        uint32_t outside = Class::outside(loadBlock(text + pos));
+        if(outside) return pos + __builtin_ctz(outside);
+        pos += BLOCK_SIZE;
+    }
+#endif
+    
+    while(pos < end && Class::contains(text[pos])) pos++;
+    return pos;
+}
+
+/// Count the line breaks in source between from and to.
+static int countNewlines(const std::string& source, size_t from, size_t to) {
+    const char* text = source.data();
+    int count = 0;
+    
+#ifdef SCANNER_SIMD
+    while(from + BLOCK_SIZE <= to) {
+        count += __builtin_popcount(toMask(isByte(loadBlock(text + from), '\n')));
+        from += BLOCK_SIZE;
+    }
+#endif
+    
+    for(; from < to; from++) {
+        if(text[from] == '\n') count++;
+    }
+    return count;
+}
+
+struct Keyword {
+    std::string_view text;
+    TokenType type;
+};
+
+static constexpr Keyword keywords[] = {
+    {"and", TOKEN_AND}, {"break", TOKEN_BREAK}, {"case", TOKEN_CASE}, {"class", TOKEN_CLASS},
+    {"const", TOKEN_CONST}, {"continue", TOKEN_CONTINUE}, {"default", TOKEN_DEFAULT}, {"delete", TOKEN_DEL},
+    {"else", TOKEN_ELSE}, {"false", TOKEN_FALSE}, {"for", TOKEN_FOR}, {"fun", TOKEN_FUN},
+    {"if", TOKEN_IF}, {"import", TOKEN_IMPORT}, {"nul", TOKEN_NUL}, {"or", TOKEN_OR},
+    {"print", TOKEN_PRINT}, {"return", TOKEN_RETURN}, {"super", TOKEN_SUPER}, {"switch", TOKEN_SWITCH},
+    {"this", TOKEN_THIS}, {"true", TOKEN_TRUE}, {"var", TOKEN_VAR}, {"while", TOKEN_WHILE},
+};
+
+static constexpr size_t KEYWORD_SLOTS = 64;
+
+/// Perfect hash over the keywords: no two keywords share a slot, so an identifier is a keyword
+/// exactly when it equals the keyword stored in its slot. Adding a keyword may require new multipliers.
+static constexpr size_t keywordHash(std::string_view text) {
+    return ((unsigned char)text[0] * 3 + (unsigned char)text[text.size() - 1] * 37 + text.size()) & (KEYWORD_SLOTS - 1);
+}
+
+static constexpr std::array<Keyword, KEYWORD_SLOTS> buildKeywordTable() {
+    std::array<Keyword, KEYWORD_SLOTS> table{};
+    for(const Keyword& keyword : keywords) {
+        table[keywordHash(keyword.text)] = keyword;
+    }
+    return table;
+}
+
+static constexpr std::array<Keyword, KEYWORD_SLOTS> keywordTable = buildKeywordTable();
+
+static constexpr bool keywordHashIsPerfect() {
+    for(const Keyword& keyword : keywords) {
+        if(keywordTable[keywordHash(keyword.text)].text != keyword.text) return false;
+    }
+    return true;
+}
+
+static_assert(keywordHashIsPerfect(), "Keywords collide in the keyword hash");
+
+
+Token::Token(TokenType type, std::string_view source, size_t start, size_t length, int line) {
     this->type = type;
     this->source = source.substr(start, length);
     this->length = length;
@@ -16,7 +191,7 @@ Token Scanner::makeToken(TokenType type) {
     return Token(type, source, start, current - start, line);
 }
 
-Token Scanner::errorToken(const std::string& message) {
+Token Scanner::errorToken(std::string_view message) {
     return Token(TOKEN_ERROR, message, 0, message.length(), this->line);
 }
 
@@ -24,13 +199,40 @@ Scanner::Scanner() {
     start = 0;
     current = 0;
     line = 1;
+    nextToken = 0;
+}
+
+void Scanner::setSource(std::string src) {
+    start = 0;
+    current = 0;
+    line = 1;
+    nextToken = 0;
+    tokens.clear();
+    interpolations.clear();
+    source = std::move(src);
+}
+
+void Scanner::tokenize() {
+    rewind();
+    tokens.clear();
+    
+    //Roughly one token every four characters of source
+    tokens.reserve(source.length() / 4 + 1);
+    
+    Token token = lexToken();
+    while(token.type != TOKEN_EOF) {
+        tokens.push_back(token);
+        token = lexToken();
+    }
+    tokens.push_back(token);
 }
 
-void Scanner::setSource(const std::string &src) {
+void Scanner::rewind() {
     start = 0;
     current = 0;
     line = 1;
-    source = src;
+    nextToken = 0;
+    interpolations.clear();
 }
 
 char Scanner::advance() {
@@ -57,38 +259,22 @@ char Scanner::peekNext() {
 
 void Scanner::skipWhitespace() {
     for(;;) {
-        char c = peek();
-        switch (c) {
-            case ' ':
-            case '\r':
-            case '\t':
-                advance();
-                break;
-                
-            case '\n':
-                line++;
-                advance();
-                break;
-                
-            case '/':
-                if (peekNext() == '/') {
-                    while(peek() != '\n' && !isAtEnd()) advance();
-                } else
-                    return;
-                
-                break;
-            
-            default:
-                return;
+        size_t blankEnd = skipWhile<Blank>(source, current);
+        line += countNewlines(source, current, blankEnd);
+        current = (int)blankEnd;
+        
+        if(peek() == '/' && peekNext() == '/') {
+            current = (int)skipWhile<CommentBody>(source, current);
+        } else {
+            return;
         }
     }
 }
 
 Token Scanner::string() {
-    while (peek() != '\"' && !isAtEnd()) {
-        if(peek() == '\n') line++;
-        advance();
-    }
+    size_t close = skipWhile<StringBody>(source, current);
+    line += countNewlines(source, current, close);
+    current = (int)close;
     
     if (isAtEnd()) {
         return errorToken("Unterminated string.");
@@ -98,15 +284,53 @@ Token Scanner::string() {
     return makeToken(TOKEN_STRING);
 }
 
+Token Scanner::templateString() {
+    for(;;) {
+        size_t stop = skipWhile<TemplateBody>(source, current);
+        line += countNewlines(source, current, stop);
+        current = (int)stop;
+        
+        if(isAtEnd()) return errorToken("Unterminated string.");
+        
+        if(advance() == '`') return makeToken(TOKEN_STRING);
+        if(match('{')) {
+            interpolations.push_back(0);
+            return makeToken(TOKEN_INTERPOLATION);
+        }
+    }
+}
+
 Token Scanner::number() {
-    while(isdigit(peek())) advance();
+    //Hexadecimal and binary literals are always whole
+    if(source[start] == '0' && (peek() == 'x' || peek() == 'X') && isxdigit(peekNext())) {
+        advance();
+        while(isxdigit(peek())) advance();
+        return makeToken(TOKEN_NUMBER);
+    }
+    if(source[start] == '0' && (peek() == 'b' || peek() == 'B') && (peekNext() == '0' || peekNext() == '1')) {
+        advance();
+        while(peek() == '0' || peek() == '1') advance();
+        return makeToken(TOKEN_NUMBER);
+    }
+    
+    current = (int)skipWhile<Digit>(source, current);
     
     bool isFloat = false;
     if (peek() == '.' && isdigit(peekNext())) {
         isFloat = true;
         advance();
         
-        while (isdigit(peek())) advance();
+        current = (int)skipWhile<Digit>(source, current);
+    }
+    
+    //An exponent without digits is not part of the number
+    if(peek() == 'e' || peek() == 'E') {
+        size_t digits = current + 1;
+        if(digits < source.length() && (source[digits] == '+' || source[digits] == '-')) digits++;
+        if(digits < source.length() && isdigit(source[digits])) {
+            isFloat = true;
+            current = (int)skipWhile<Digit>(source, digits);
+        }
     }
     
     if(isFloat) {
@@ -116,98 +340,29 @@ Token Scanner::number() {
     }
 }
 
-TokenType Scanner::checkKeyword(int start, int length,
-                                const std::string& rest, TokenType type) {
-    
-    if (current - this->start == start + length &&
-        this->source.substr(start + this->start, length).compare(rest) == 0)
-        return type;
-    
-    return TOKEN_IDENTIFIER;
-}
-
 TokenType Scanner::identifierType() {
-    switch(source[start]) {
-        case 'a': return checkKeyword(1, 2, "nd", TOKEN_AND);
-        case 'b': return checkKeyword(1, 4, "reak", TOKEN_BREAK);
-        case 'c':
-            if (current - start > 1) {
-                switch(source[start + 1]) {
-                    case 'a': return checkKeyword(2, 2, "se", TOKEN_CASE);
-                    case 'l': return checkKeyword(2, 3, "ass", TOKEN_CLASS);
-                    case 'o':
-                        if(current - start > 2) {
-                            switch (source[start + 2]) {
-                                case 'n':
-                                    if(current - start > 3) {
-                                        switch (source[start + 3]) {
-                                            case 's': return checkKeyword(4, 1, "t", TOKEN_CONST);
-                                            case 't': return checkKeyword(4, 4, "inue", TOKEN_CONTINUE);
-                                        }
-                                    }
-                            }
-                        }
-                }
-            }
-        case 'd': if (current - start > 1) {
-            switch (source[start + 1]) {
-                case 'e':
-                    if(current - start > 2) {
-                        switch (source[start + 2]) {
-                            case 'f': return checkKeyword(3, 4, "ault", TOKEN_DEFAULT);
-                            case 'l': return checkKeyword(3, 3, "ete", TOKEN_DEL);
-                        }
-                    }
-            }
-        }
-        case 'e': return checkKeyword(1, 3, "lse", TOKEN_ELSE);
-        case 'f':
-            if (current - start > 1) {
-                switch(source[start + 1]) {
-                    case 'a': return checkKeyword(2, 3, "lse", TOKEN_FALSE);
-                    case 'o': return checkKeyword(2, 1, "r", TOKEN_FOR);
-                    case 'u': return checkKeyword(2, 1, "n", TOKEN_FUN);
-                }
-            }
-        case 'i': if(current - start > 1) {
-            switch (source[start + 1]) {
-                case 'f': return TOKEN_IF;
-                case 'm': return checkKeyword(2, 4, "port", TOKEN_IMPORT);
-            }
-        }
-            
-        case 'n': return checkKeyword(1, 2, "ul", TOKEN_NUL);
-        case 'o': return checkKeyword(1, 1, "r", TOKEN_OR);
-        case 'p': return checkKeyword(1, 4, "rint", TOKEN_PRINT);
-        case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-        case 's':
-            if(current - start > 1) {
-                switch(source[start + 1]) {
-                    case 'w': return checkKeyword(2, 4, "itch", TOKEN_SWITCH);
-                    case 'u': return checkKeyword(2, 3, "per", TOKEN_SUPER);
-                }
-            }
-        case 't':
-            if (current - start > 1) {
-                switch(source[start + 1]) {
-                    case 'h': return checkKeyword(2, 2, "is", TOKEN_THIS);
-                    case 'r': return checkKeyword(2, 2, "ue", TOKEN_TRUE);
-                }
-            }
-        case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
-        case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
-    }
+    std::string_view text(source.data() + start, current - start);
+    const Keyword& keyword = keywordTable[keywordHash(text)];
     
-    return TOKEN_IDENTIFIER;
+    return keyword.text == text ? keyword.type : TOKEN_IDENTIFIER;
 }
 
 Token Scanner::identifier() {
-    while (isalpha(peek()) || isdigit(peek()) || peek() == '_') advance();
+    current = (int)skipWhile<IdentifierChar>(source, current);
     
     return makeToken(identifierType());
 }
 
 Token Scanner::scanToken() {
+    if(!tokens.empty()) {
+        //The last token is EOF, keep handing it out once the array is exhausted
+        return nextToken < tokens.size() - 1 ? tokens[nextToken++] : tokens.back();
+    }
+    
+    return lexToken();
+}
+
+Token Scanner::lexToken() {
     
     skipWhitespace();
     
@@ -225,8 +380,18 @@ Token Scanner::scanToken() {
     switch(c) {
         case '(': return makeToken(TOKEN_LEFT_PAREN);
         case ')': return makeToken(TOKEN_RIGHT_PAREN);
-        case '{': return makeToken(TOKEN_LEFT_BRACE);
-        case '}': return makeToken(TOKEN_RIGHT_BRACE);
+        case '{':
+            if(!interpolations.empty()) interpolations.back()++;
+            return makeToken(TOKEN_LEFT_BRACE);
+        case '}':
+            if(!interpolations.empty()) {
+                if(interpolations.back() == 0) {
+                    interpolations.pop_back();
+                    return templateString();
+                }
+                interpolations.back()--;
+            }
+            return makeToken(TOKEN_RIGHT_BRACE);
         case '[': return makeToken(TOKEN_LEFT_BRACK);
         case ']': return makeToken(TOKEN_RIGHT_BRACK);
         case ';': return makeToken(TOKEN_SEMICOLON);
@@ -236,6 +401,12 @@ Token Scanner::scanToken() {
         case '+': return makeToken(TOKEN_PLUS);
         case '/': return makeToken(TOKEN_SLASH);
         case '*': return makeToken(TOKEN_STAR);
+        case '%': return makeToken(TOKEN_PERCENT);
+        case '\\': return makeToken(TOKEN_BACKSLASH);
+        case '&': return makeToken(TOKEN_AMPERSAND);
+        case '|': return makeToken(TOKEN_PIPE);
+        case '^': return makeToken(TOKEN_CARET);
+        case '~': return makeToken(TOKEN_TILDE);
         case '?': return makeToken(TOKEN_QUESTION_MARK);
         case ':': return makeToken(TOKEN_COLON);
         case '!':
@@ -245,14 +416,18 @@ Token Scanner::scanToken() {
               return makeToken(
                         match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
         case '<':
+              if(match('<')) return makeToken(TOKEN_LESS_LESS);
               return makeToken(
                         match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
         case '>':
+              if(match('>')) return makeToken(match('>') ? TOKEN_GREATER_GREATER_GREATER : TOKEN_GREATER_GREATER);
               return makeToken(
                         match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
             
         case '"':
             return string();
+        case '`':
+            return templateString();
     }
     
     return errorToken("Unexpected character.");
@@ -260,6 +435,12 @@ Token Scanner::scanToken() {
 
 
 Token Token::createToken(const std::string& text) {
-    Token token(TOKEN_IDENTIFIER, text, 0, text.size(), 0);
+    //Elements of an unordered_set never move, so tokens can safely refer to them
+    static std::unordered_set<std::string> arena;
+    static std::mutex arenaLock;
+    
+    std::lock_guard<std::mutex> guard(arenaLock);
+    const std::string& stored = *arena.insert(text).first;
+    Token token(TOKEN_IDENTIFIER, stored, 0, stored.size(), 0);
     return token;
 }
@@ -13,14 +13,17 @@ enum TokenType {
     TOKEN_LEFT_BRACK, TOKEN_RIGHT_BRACK,
     TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
     TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_STAR,
+    TOKEN_PERCENT, TOKEN_BACKSLASH,
+    TOKEN_AMPERSAND, TOKEN_PIPE, TOKEN_CARET, TOKEN_TILDE,
     
     TOKEN_BANG, TOKEN_BANG_EQUAL,
     TOKEN_EQUAL, TOKEN_EQUAL_EQUAL,
     TOKEN_GREATER, TOKEN_GREATER_EQUAL,
     TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_QUESTION_MARK,
     TOKEN_COLON,
+    TOKEN_LESS_LESS, TOKEN_GREATER_GREATER, TOKEN_GREATER_GREATER_GREATER,
     
-    TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER, TOKEN_FLOAT,
+    TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_INTERPOLATION, TOKEN_NUMBER, TOKEN_FLOAT,
     
     TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
     TOKEN_FOR, TOKEN_FUN, TOKEN_IF, TOKEN_NUL, TOKEN_OR,
@@ -33,13 +36,19 @@ enum TokenType {
     TOKEN_EOF
 };
 
+/// A token refers to its lexeme inside the scanned source instead of owning a copy,
+/// so the source must outlive every token scanned from it.
 struct Token {
     TokenType type;
-    std::string source;
+    std::string_view source;
     size_t length;
     int line;
     
-    Token(TokenType type, const std::string& source, int start, size_t length, int line);
+    Token(TokenType type, std::string_view source, size_t start, size_t length, int line);
+    
+    /// Create a synthetic identifier token that does not come from any source.
+    /// The text is copied into an arena that lives for the rest of the program.
+    /// @param text Text of the identifier
     static Token createToken(const std::string& text);
 };
 
@@ -48,18 +57,35 @@ class Scanner {
     char advance();
     bool isAtEnd();
     Token makeToken(TokenType type);
-    Token errorToken(const std::string& message);
+    
+    /// Make an error token. The message must be a string literal as the token only refers to it.
+    /// @param message Error message
+    Token errorToken(std::string_view message);
     bool match(char expected);
     void skipWhitespace();
     char peek();
     char peekNext();
     Token string();
+    
+    /// Scan a segment of a template string, from its opening backtick or the brace closing an interpolation
+    /// up to the closing backtick, which makes a TOKEN_STRING, or up to the next ${, which makes a TOKEN_INTERPOLATION.
+    Token templateString();
     Token number();
     Token identifier();
     TokenType identifierType();
-    TokenType checkKeyword(int start, int length,
-                           const std::string& rest, TokenType type);
     
+    /// Scan the next token from the source
+    Token lexToken();
+    
+    /// Tokens scanned ahead of parsing by tokenize
+    std::vector<Token> tokens;
+    
+    /// Position of the next token handed out from tokens
+    size_t nextToken;
+    
+    /// Number of unclosed braces inside each template string interpolation being scanned, innermost last.
+    /// The brace that closes an interpolation resumes scanning its template string.
+    std::vector<int> interpolations;
     
 public:
     std::string source;
@@ -68,8 +94,20 @@ public:
     int line;
     
     Scanner();
+    
+    /// Return the next token, either by scanning it or from the token array if the source was tokenized.
     Token scanToken();
-    void setSource(const std::string& src);
+    
+    /// Take over the source to scan. Pass an rvalue to move the source into the scanner instead of copying it.
+    /// @param src Source code
+    void setSource(std::string src);
+    
+    /// Scan the whole source up front into a compact token array.
+    /// Following calls to scanToken read from the array instead of scanning.
+    void tokenize();
+    
+    /// Restart scanning from the beginning of the source.
+    void rewind();
 };
 
 #endif /* scanner_hpp */
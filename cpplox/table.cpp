@@ -15,6 +15,9 @@ Table::Table(VM* vm) {
 
 
 bool Table::tableSet(Value key, Value value) {
+    //String keys are interned, so lookups with interned names match by identity and entries never keep a rope alive
+    if(vm != nullptr && ValueOP::is_string(key)) key = ValueOP::obj_val(ValueOP::intern_string(key, vm));
+    
     if(count + 1 > this->entries.size() * TABLE_MAX_LOAD) {
         size_t newCapacity = grow_capacity(this->entries.capacity());
         adjustCapacity(newCapacity);
@@ -118,8 +121,8 @@ ObjString* Table::tableFindString(const char *chars, size_t length, uint32_t has
             
             ObjString* key = ValueOP::as_string(entry->key);
             
-            if (key->chars.length() == length && key->hash == hash &&
-                key->chars.compare(chars) == 0) {
+            if (key->length == length && key->getHash() == hash &&
+                memcmp(key->chars(), chars, length) == 0) {
                 return key;
             }
         }
@@ -1,4 +1,5 @@
 #include <gtest/gtest.h>
+#include <chrono>
 #include "../pch.pch"
 #include "../scanner.hpp"
 #include "../chunk.hpp"
@@ -6,6 +7,7 @@
 #include "../table.hpp"
 #include "../value.hpp"
 #include "../object.hpp"
+#include "../flags.hpp"
 
 class Scanner_Test : public testing::Test {
 protected:
@@ -225,7 +227,19 @@ TEST_F(Scanner_Test, number) {
     
     EXPECT_EQ(token.type, TOKEN_NUMBER);
     EXPECT_EQ(token.length, 3);
-    EXPECT_EQ(std::stoi(token.source), 123);
+    EXPECT_EQ(std::stoi(std::string(token.source)), 123);
+}
+
+TEST_F(Scanner_Test, number_literals) {
+    scan.setSource("0x1F 0b101 1e10 2.5E-3 1e");
+    TokenType expected[] = {TOKEN_NUMBER, TOKEN_NUMBER, TOKEN_FLOAT, TOKEN_FLOAT, TOKEN_NUMBER, TOKEN_IDENTIFIER};
+    size_t lengths[] = {4, 5, 4, 6, 1, 1};
+    
+    for(size_t i = 0; i < 6; i++) {
+        Token token = scan.scanToken();
+        EXPECT_EQ(token.type, expected[i]);
+        EXPECT_EQ(token.length, lengths[i]);
+    }
 }
 
 TEST_F(Scanner_Test, token_and) {
@@ -463,6 +477,81 @@ TEST_F(Scanner_Test, spaces) {
     EXPECT_EQ(four.source.compare("fourth"), 0);
 }
 
+TEST_F(Scanner_Test, keyword_prefix) {
+    scan.setSource("iffy classes delete_all");
+    
+    EXPECT_EQ(scan.scanToken().type, TOKEN_IDENTIFIER);
+    EXPECT_EQ(scan.scanToken().type, TOKEN_IDENTIFIER);
+    EXPECT_EQ(scan.scanToken().type, TOKEN_IDENTIFIER);
+}
+
+TEST_F(Scanner_Test, long_runs) {
+    std::string blank(100, ' ');
+    std::string body(100, 'a');
+    scan.setSource(blank + "\n" + blank + "\"" + body + "\n" + body + "\"" + blank + "// " + body + "\n" + body + "_1");
+    
+    Token string = scan.scanToken();
+    EXPECT_EQ(string.type, TOKEN_STRING);
+    EXPECT_EQ(string.length, 203);
+    EXPECT_EQ(string.line, 3);
+    
+    Token identifier = scan.scanToken();
+    EXPECT_EQ(identifier.type, TOKEN_IDENTIFIER);
+    EXPECT_EQ(identifier.length, 102);
+    EXPECT_EQ(identifier.line, 4);
+}
+
+TEST_F(Scanner_Test, bitwise_operators) {
+    scan.setSource("% \\ & | ^ ~ << >> >>> <= >=");
+    
+    TokenType expected[] = {TOKEN_PERCENT, TOKEN_BACKSLASH, TOKEN_AMPERSAND, TOKEN_PIPE, TOKEN_CARET, TOKEN_TILDE,
+                            TOKEN_LESS_LESS, TOKEN_GREATER_GREATER, TOKEN_GREATER_GREATER_GREATER,
+                            TOKEN_LESS_EQUAL, TOKEN_GREATER_EQUAL, TOKEN_EOF};
+    for(TokenType type : expected) {
+        EXPECT_EQ(scan.scanToken().type, type);
+    }
+}
+
+TEST_F(Scanner_Test, tokenize) {
+    scan.setSource("var a = 1;\nprint a;");
+    scan.tokenize();
+    
+    TokenType expected[] = {TOKEN_VAR, TOKEN_IDENTIFIER, TOKEN_EQUAL, TOKEN_NUMBER, TOKEN_SEMICOLON,
+                            TOKEN_PRINT, TOKEN_IDENTIFIER, TOKEN_SEMICOLON, TOKEN_EOF, TOKEN_EOF};
+    for(TokenType type : expected) {
+        EXPECT_EQ(scan.scanToken().type, type);
+    }
+    
+    scan.rewind();
+    Token first = scan.scanToken();
+    EXPECT_EQ(first.type, TOKEN_VAR);
+    EXPECT_EQ(first.line, 1);
+}
+
+TEST_F(Scanner_Test, synthetic_token) {
+    Token token = Token::createToken(std::string("synthetic"));
+    
+    EXPECT_EQ(token.type, TOKEN_IDENTIFIER);
+    EXPECT_EQ(token.length, 9);
+    EXPECT_EQ(token.source.compare("synthetic"), 0);
+}
+
+TEST_F(Scanner_Test, template_string) {
+    scan.setSource("`a ${ {b} } c ${d}`");
+    TokenType expected[] = {TOKEN_INTERPOLATION, TOKEN_LEFT_BRACE, TOKEN_IDENTIFIER, TOKEN_RIGHT_BRACE,
+        TOKEN_INTERPOLATION, TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_EOF};
+    
+    Token first = scan.scanToken();
+    EXPECT_EQ(first.type, expected[0]);
+    EXPECT_EQ(first.source.compare("`a ${"), 0);
+    for(size_t i = 1; i < 4; i++) EXPECT_EQ(scan.scanToken().type, expected[i]);
+    
+    Token middle = scan.scanToken();
+    EXPECT_EQ(middle.type, expected[4]);
+    EXPECT_EQ(middle.source.compare("} c ${"), 0);
+    for(size_t i = 5; i < 8; i++) EXPECT_EQ(scan.scanToken().type, expected[i]);
+}
+
 
 class Chunk_test : public testing::Test {
 protected:
@@ -664,10 +753,10 @@ TEST_F(Value_test, bool_test) {
 
     
     string = ValueOP::to_string(true_value, &vm);
-    EXPECT_STREQ(string->chars.c_str(), "true");
+    EXPECT_STREQ(string->chars(), "true");
     
     string = ValueOP::to_string(false_value, &vm);
-    EXPECT_STREQ(string->chars.c_str(), "false");
+    EXPECT_STREQ(string->chars(), "false");
     
     EXPECT_FALSE(ValueOP::valuesEqual(true_value, false_value));
     EXPECT_FALSE(ValueOP::valuesEqual(false_value, true_value));
@@ -686,7 +775,7 @@ TEST_F(Value_test, number_test) {
     EXPECT_TRUE(print_value_test(num_value, "123"));
     
     ObjString* string = ValueOP::to_string(num_value, &vm);
-    EXPECT_STREQ(string->chars.c_str(), "123.000000");
+    EXPECT_STREQ(string->chars(), "123");
     
     EXPECT_TRUE(ValueOP::valuesEqual(num_value, ValueOP::number_val(123)));
     EXPECT_FALSE(ValueOP::valuesEqual(num_value, ValueOP::number_val(124)));
@@ -697,14 +786,14 @@ TEST_F(Value_test, object_string_test) {
     Value string_val = ValueOP::obj_val(s);
     
     EXPECT_EQ(s->type, OBJ_STRING);
-    EXPECT_STREQ(s->chars.c_str(), "test");
+    EXPECT_STREQ(s->chars(), "test");
     
     EXPECT_EQ(ObjString::hashString("abcde", 5), ObjString::hashString("abcde", 5));
     
     EXPECT_EQ(string_val.type, VAL_OBJ);
     EXPECT_TRUE(ValueOP::is_obj(string_val));
     EXPECT_TRUE(ValueOP::is_string(string_val));
-    EXPECT_STREQ(ValueOP::as_string(string_val)->chars.c_str(), "test");
+    EXPECT_STREQ(ValueOP::as_string(string_val)->chars(), "test");
     
     EXPECT_TRUE(print_value_test(string_val, "test"));
     
@@ -723,7 +812,7 @@ TEST_F(Value_test, function_test) {
     EXPECT_EQ(f->type, OBJ_FUNCTION);
     EXPECT_TRUE(ValueOP::is_obj(function_val));
     EXPECT_TRUE(ValueOP::is_function(function_val));
-    EXPECT_STREQ(f->name->chars.c_str(), "abc");
+    EXPECT_STREQ(f->name->chars(), "abc");
     
     EXPECT_TRUE(print_value_test(function_val, "<fn abc>"));
     
@@ -792,7 +881,7 @@ TEST_F(Value_test, class_test) {
     EXPECT_TRUE(print_value_test(_class_val, "test_class"));
     
     EXPECT_EQ(ValueOP::as_class(_class_val), _class);
-    EXPECT_STREQ(_class->name->chars.c_str(), "test_class");
+    EXPECT_STREQ(_class->name->chars(), "test_class");
     EXPECT_EQ(_class->name, name);
     
     EXPECT_EQ(_class->initializer, nullptr);
@@ -893,6 +982,97 @@ TEST_F(Value_test, collection_instance_test) {
     EXPECT_EQ(ValueOP::as_native_subinstance<ObjCollectionInstance>(instance_val), instance);
 }
 
+TEST_F(Value_test, string_layout) {
+    ObjString* s = ObjString::copyString(&vm, "inline");
+    
+    EXPECT_EQ(s->length, 6);
+    EXPECT_EQ((void*)s->chars(), (void*)(s + 1));
+    EXPECT_EQ(s->chars()[6], '\0');
+    EXPECT_EQ(ObjString::concatenate(&vm, s->view(), s->view())->view(), "inlineinline");
+}
+
+TEST_F(Value_test, rope_flatten) {
+    ObjString* half = ObjString::copyString(&vm, std::string(ROPE_MIN_LENGTH, 'a'));
+    ObjRope* rope = ObjRope::newRope(&vm, half, half, 2 * half->length);
+    ObjRope* longer = ObjRope::newRope(&vm, rope, half, 3 * half->length);
+    Value a = ValueOP::obj_val(rope);
+    
+    EXPECT_TRUE(ValueOP::is_string(a));
+    EXPECT_EQ(ValueOP::string_length(ValueOP::obj_val(longer)), 3 * ROPE_MIN_LENGTH);
+    EXPECT_FALSE(ValueOP::valuesEqual(a, ValueOP::obj_val(longer)));
+    EXPECT_EQ(rope->flat, nullptr);
+    
+    ObjString* flat = ObjString::copyString(&vm, std::string(2 * ROPE_MIN_LENGTH, 'a'));
+    EXPECT_TRUE(ValueOP::valuesEqual(a, ValueOP::obj_val(flat)));
+    EXPECT_EQ(rope->flat->view(), flat->view());
+    EXPECT_EQ(ValueOP::as_string(ValueOP::obj_val(longer))->length, 3 * ROPE_MIN_LENGTH);
+}
+
+TEST_F(Value_test, string_builder) {
+    ObjStringBuilderClass* _class = ObjStringBuilderClass::newStringBuilderClass(ObjString::copyString(&vm, "StringBuilder"), &vm);
+    ObjStringBuilderInstance* builder = ObjStringBuilderInstance::newStringBuilderInstance(_class, &vm);
+    Value args[] = {ValueOP::number_val(12ll), ValueOP::bool_val(true), ValueOP::nul_val()};
+    
+    _class->init(builder, 1, args);
+    _class->append(builder, 1, args + 1);
+    _class->appendLine(builder, 1, args + 2);
+    EXPECT_EQ(builder->buffer, "12truenul\n");
+    
+    NativeClassRes res = _class->toString(builder, 0, nullptr);
+    EXPECT_EQ(ValueOP::as_string(res.returnVal)->view(), "12truenul\n");
+    
+    _class->clear(builder, 0, nullptr);
+    EXPECT_EQ(Number::cast_to<size_t>(ValueOP::as_number(_class->length(builder, 0, nullptr).returnVal)), 0);
+}
+
+TEST_F(Value_test, lazy_interning) {
+    ObjString* interned = ObjString::copyString(&vm, "lazy");
+    ObjString* transient = ObjString::newString(&vm, "lazy");
+    int count = vm.strings.count;
+    
+    EXPECT_NE(transient, interned);
+    EXPECT_FALSE(transient->hashed);
+    EXPECT_TRUE(ValueOP::valuesEqual(ValueOP::obj_val(transient), ValueOP::obj_val(interned)));
+    EXPECT_FALSE(ValueOP::valuesEqual(ValueOP::obj_val(transient), ValueOP::obj_val(ObjString::newString(&vm, "lazz"))));
+    
+    Table table(&vm);
+    table.tableSet(ValueOP::obj_val(transient), ValueOP::nul_val());
+    EXPECT_EQ(ValueOP::as_obj(table.entries[interned->hash & (table.entries.size() - 1)].key), interned);
+    EXPECT_EQ(vm.strings.count, count);
+    
+    EXPECT_EQ(ObjString::newString(&vm, "fresh")->intern(&vm)->intern(&vm)->view(), "fresh");
+    EXPECT_EQ(vm.strings.count, count + 1);
+}
+
+TEST_F(Value_test, string_slice) {
+    Value parent = ValueOP::obj_val(ObjString::copyString(&vm, "2024-01-01 INFO started"));
+    Value slice = ObjSlice::substring(&vm, parent, 11, 4);
+    
+    ASSERT_TRUE(ValueOP::isObjType(slice, OBJ_SLICE));
+    EXPECT_EQ(ValueOP::as_slice(slice)->parent, ValueOP::as_string(parent));
+    EXPECT_EQ(ValueOP::as_string_view(slice), "INFO");
+    EXPECT_TRUE(ValueOP::valuesEqual(slice, ValueOP::obj_val(ObjString::copyString(&vm, "INFO"))));
+    EXPECT_EQ(ValueOP::hashValue(slice), ObjString::copyString(&vm, "INFO")->getHash());
+    
+    Value nested = ObjSlice::substring(&vm, slice, 1, 2);
+    EXPECT_EQ(ValueOP::as_slice(nested)->parent, ValueOP::as_string(parent));
+    EXPECT_EQ(ValueOP::as_string_view(nested), "NF");
+    EXPECT_EQ(ValueOP::intern_string(nested, &vm), ObjString::copyString(&vm, "NF"));
+    
+    ObjString* big = ObjString::copyString(&vm, std::string(2 * SLICE_RETAIN_LIMIT, 'x'));
+    EXPECT_TRUE(ValueOP::isObjType(ObjSlice::substring(&vm, ValueOP::obj_val(big), 0, 10), OBJ_STRING));
+}
+
+TEST_F(Value_test, number_format) {
+    std::string text;
+    ValueOP::append_string(ValueOP::number_val(0.1 + 0.2), text);
+    text += " ";
+    ValueOP::append_string(ValueOP::number_val(-42ll), text);
+    text += " ";
+    ValueOP::append_string(ValueOP::number_val(1500.0), text);
+    EXPECT_EQ(text, "0.30000000000000004 -42 1500.0");
+}
+
 class Table_test : public testing::Test {
 protected:
     VM vm;
@@ -968,7 +1148,74 @@ TEST_F(Table_test, find_string_test) {
     table.tableSet(name_val, ValueOP::number_val(123));
     ObjString* res = table.tableFindString("test_test", 9, ObjString::hashString("test_test", 9));
     ASSERT_NE(res, nullptr);
-    EXPECT_STREQ(res->chars.c_str(), "test_test");
+    EXPECT_STREQ(res->chars(), "test_test");
+}
+
+//Microbenchmark of intern table lookups, run with --gtest_also_run_disabled_tests
+TEST_F(Table_test, DISABLED_intern_lookup_throughput) {
+    const size_t lengths[] = {4, 16, 64, 256, 4096};
+    for(size_t length : lengths) {
+        std::vector<std::string> keys;
+        for(size_t i = 0; i < 1000; i++) {
+            std::string key = std::to_string(i * 7919);
+            key.resize(length, 'x');
+            keys.push_back(key);
+            
+            //Interned strings are weak, keep them on the stack so a collection does not remove them
+            vm.push_stack(ValueOP::obj_val(ObjString::copyString(&vm, key)));
+        }
+        
+        size_t rounds = 4000000 / (length + 16);
+        auto start = std::chrono::steady_clock::now();
+        size_t found = 0;
+        for(size_t round = 0; round < rounds; round++) {
+            const std::string& key = keys[round % keys.size()];
+            found += vm.strings.tableFindString(key.data(), key.size(), ObjString::hashString(key.data(), key.size())) != nullptr;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        EXPECT_EQ(found, rounds);
+        vm.stack.clear();
+        std::cout << "length " << length << ": " << seconds * 1e9 / rounds << " ns per lookup, "
+                  << rounds * length / seconds / 1e6 << " MB/s" << std::endl;
+    }
+}
+
+class VM_test : public testing::Test {
+protected:
+    VM vm;
+};
+
+TEST_F(VM_test, string_library) {
+    Value args[4] = {ValueOP::nul_val(), ValueOP::obj_val(ObjString::copyString(&vm, "one two one two")),
+        ValueOP::obj_val(ObjString::copyString(&vm, "two")), ValueOP::obj_val(ObjString::copyString(&vm, "2"))};
+    
+    ASSERT_TRUE(vm.indexOfNative(2, args + 1));
+    EXPECT_EQ(Number::cast_to<size_t>(ValueOP::as_number(args[0])), 4);
+    
+    ASSERT_TRUE(vm.replaceNative(3, args + 1));
+    EXPECT_EQ(ValueOP::as_string_view(args[0]), "one 2 one 2");
+    
+    ASSERT_TRUE(vm.upperNative(1, args + 1));
+    EXPECT_EQ(ValueOP::as_string_view(args[0]), "ONE TWO ONE TWO");
+    
+    Value repeat[3] = {ValueOP::nul_val(), ValueOP::obj_val(ObjString::copyString(&vm, "ab")), ValueOP::number_val(3ll)};
+    ASSERT_TRUE(vm.repeatNative(2, repeat + 1));
+    EXPECT_EQ(ValueOP::as_string_view(repeat[0]), "ababab");
+    EXPECT_FALSE(vm.repeatNative(2, args + 1));
+}
+
+TEST_F(VM_test, buffered_output) {
+    vm.outputBuffer.lineBuffered = false;
+    testing::internal::CaptureStdout();
+    
+    vm.output << "unflushed ";
+    Value args[1] = {ValueOP::nul_val()};
+    ASSERT_TRUE(vm.flushNative(0, args + 1));
+    
+    //Printing is flushed once the script ends
+    vm.interpret("print 1; print `a${2}`;");
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "unflushed 1\na2\n");
 }
 
 class Compiler_test : public testing::Test {
@@ -991,18 +1238,18 @@ protected:
 };
 
 TEST_F(Compiler_test, compile_number) {
-    ObjFunction *func = compiler->compile("123;");
+    ObjFunction *func = compiler->compile("print 123;");
     
     EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
-    EXPECT_EQ(func->chunk.code[2], OP_POP);
+    EXPECT_EQ(func->chunk.code[2], OP_PRINT);
 }
 
 TEST_F(Compiler_test, compile_grouping) {
-    ObjFunction *func = compiler->compile("2 * (2 + 3);");
+    ObjFunction *func = compiler->compile("2 * (a + 3);");
     ASSERT_TRUE(func);
     
     EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
-    EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[2], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[4], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[6], OP_ADD);
     EXPECT_EQ(func->chunk.code[7], OP_MULTIPLY);
@@ -1010,19 +1257,19 @@ TEST_F(Compiler_test, compile_grouping) {
 }
 
 TEST_F(Compiler_test, compile_unary) {
-    ObjFunction *func = compiler->compile("-123;");
+    ObjFunction *func = compiler->compile("-a;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_NEGATE);
     EXPECT_EQ(func->chunk.code[3], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_bangequal) {
-    ObjFunction *func = compiler->compile("123 != 234;");
+    ObjFunction *func = compiler->compile("a != 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_EQUAL);
     EXPECT_EQ(func->chunk.code[5], OP_NOT);
@@ -1030,30 +1277,30 @@ TEST_F(Compiler_test, compile_binary_bangequal) {
 }
 
 TEST_F(Compiler_test, compile_binary_equalequal) {
-    ObjFunction *func = compiler->compile("123 == 234;");
+    ObjFunction *func = compiler->compile("a == 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_EQUAL);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_greater) {
-    ObjFunction *func = compiler->compile("123 > 234;");
+    ObjFunction *func = compiler->compile("a > 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_GREATER);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_greater_equal) {
-    ObjFunction *func = compiler->compile("123 >= 234;");
+    ObjFunction *func = compiler->compile("a >= 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_LESS);
     EXPECT_EQ(func->chunk.code[5], OP_NOT);
@@ -1061,20 +1308,20 @@ TEST_F(Compiler_test, compile_binary_greater_equal) {
 }
 
 TEST_F(Compiler_test, compile_binary_less) {
-    ObjFunction *func = compiler->compile("123 < 234;");
+    ObjFunction *func = compiler->compile("a < 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_LESS);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_less_equal) {
-    ObjFunction *func = compiler->compile("123 <= 234;");
+    ObjFunction *func = compiler->compile("a <= 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_GREATER);
     EXPECT_EQ(func->chunk.code[5], OP_NOT);
@@ -1082,45 +1329,320 @@ TEST_F(Compiler_test, compile_binary_less_equal) {
 }
 
 TEST_F(Compiler_test, compile_binary_plus) {
-    ObjFunction *func = compiler->compile("123 + 234;");
+    ObjFunction *func = compiler->compile("a + 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_ADD);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_minus) {
-    ObjFunction *func = compiler->compile("123 - 234;");
+    ObjFunction *func = compiler->compile("a - 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_SUBTRACT);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_multiply) {
-    ObjFunction *func = compiler->compile("123 * 234;");
+    ObjFunction *func = compiler->compile("a * 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_MULTIPLY);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
 TEST_F(Compiler_test, compile_binary_divi) {
-    ObjFunction *func = compiler->compile("123 / 234;");
+    ObjFunction *func = compiler->compile("a / 234;");
     ASSERT_TRUE(func);
     
-    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
     EXPECT_EQ(func->chunk.code[2], OP_CONSTANT);
     EXPECT_EQ(func->chunk.code[4], OP_DIVIDE);
     EXPECT_EQ(func->chunk.code[5], OP_POP);
 }
 
+TEST_F(Compiler_test, fold_arithmetic) {
+    ObjFunction *func = compiler->compile("print 60 * 60 * (24 - -1.5);");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[2], OP_PRINT);
+    EXPECT_EQ(func->chunk.constants.count, 1);
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[0]) == Number(91800.0));
+}
+
+TEST_F(Compiler_test, fold_whole_and_float) {
+    ObjFunction *func = compiler->compile("print 1 == 1.0;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[0], OP_FALSE);
+    EXPECT_EQ(func->chunk.code[1], OP_PRINT);
+}
+
+TEST_F(Compiler_test, fold_string) {
+    ObjFunction *func = compiler->compile("print \"con\" + \"cat\";");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(ValueOP::as_string(func->chunk.constants.values[0]), ObjString::copyString(vm.get(), "concat"));
+}
+
+TEST_F(Compiler_test, fold_bitwise) {
+    ObjFunction *func = compiler->compile("print (1 << 4 | 3) & ~1 ^ 7 % 4; print 1 \\ 0;");
+    ASSERT_TRUE(func);
+    
+    //Division by zero is left to fail at runtime
+    EXPECT_EQ(func->chunk.code[0], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[2], OP_PRINT);
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[0]) == Number(17));
+    EXPECT_EQ(func->chunk.code[7], OP_INT_DIVIDE);
+}
+
+TEST_F(Compiler_test, fold_overflow) {
+    ObjFunction *func = compiler->compile("print 9223372036854775807 + 1; print 3037000500 * 3037000500; print 4 * 5;");
+    ASSERT_TRUE(func);
+    
+    //Whole numbers that overflow become floats instead of wrapping around
+    ASSERT_EQ(func->chunk.constants.count, 3);
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[0]).is_float);
+    EXPECT_GT(Number::cast_to<double>(ValueOP::as_number(func->chunk.constants.values[0])), 9e18);
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[1]).is_float);
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[2]) == Number(20));
+}
+
+TEST_F(Compiler_test, compile_slice) {
+    ObjFunction *func = compiler->compile("var s; s[1:];");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[7], OP_NUL);
+    EXPECT_EQ(func->chunk.code[8], OP_INVOKE);
+    EXPECT_EQ(func->chunk.code[10], 2);
+}
+
+TEST_F(Compiler_test, fold_stops_at_jump) {
+    ObjFunction *func = compiler->compile("(a and 1) + 2;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[8], OP_CONSTANT);
+    EXPECT_EQ(func->chunk.code[10], OP_ADD);
+}
+
+TEST_F(Compiler_test, peephole_constant_pop) {
+    ObjFunction *func = compiler->compile("123; true;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.count, 2);
+    EXPECT_EQ(func->chunk.code[0], OP_NUL);
+    EXPECT_EQ(func->chunk.code[1], OP_RETURN);
+}
+
+TEST_F(Compiler_test, peephole_not_jump) {
+    ObjFunction *func = compiler->compile("if(!a) print 1;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[0], OP_GET_GLOBAL);
+    EXPECT_EQ(func->chunk.code[2], OP_JUMP_IF_TRUE);
+    EXPECT_EQ(func->chunk.code[5], OP_POP);
+}
+
+TEST_F(Compiler_test, peephole_jump_chain) {
+    ObjFunction *func = compiler->compile("if(a) { if(b) print 1; else print 2; } else print 3;");
+    ASSERT_TRUE(func);
+    
+    Chunk& chunk = func->chunk;
+    for(size_t offset = 0; offset < chunk.count; offset++) {
+        if(chunk.code[offset] != OP_JUMP) continue;
+        
+        size_t target = offset + 3 + (chunk.code[offset + 1] << 8 | chunk.code[offset + 2]);
+        EXPECT_NE(chunk.code[target], OP_JUMP);
+    }
+}
+
+TEST_F(Compiler_test, peephole_dead_code) {
+    ObjFunction *func = compiler->compile("fun f() { return 1; print 2; }");
+    ASSERT_TRUE(func);
+    
+    ObjFunction* f = ValueOP::as_function(func->chunk.constants.values[0]);
+    EXPECT_EQ(f->chunk.count, 3);
+    EXPECT_EQ(f->chunk.code[2], OP_RETURN);
+}
+
+TEST_F(Compiler_test, optimizer_propagate_constants) {
+    OPTIMIZATION_LEVEL = 2;
+    ObjFunction *func = compiler->compile("fun f() { var a = 2; return a * 3; }");
+    OPTIMIZATION_LEVEL = 1;
+    ASSERT_TRUE(func);
+    
+    //The read of a becomes the constant 2, which then folds with 3
+    ObjFunction* f = ValueOP::as_function(func->chunk.constants.values[0]);
+    EXPECT_EQ(f->chunk.count, 5);
+    EXPECT_EQ(f->chunk.code[2], OP_CONSTANT);
+    EXPECT_EQ(ValueOP::as_number(f->chunk.constants.values[f->chunk.code[3]]), 6);
+    EXPECT_EQ(f->chunk.code[4], OP_RETURN);
+}
+
+TEST_F(Compiler_test, optimizer_common_subexpression) {
+    OPTIMIZATION_LEVEL = 2;
+    ObjFunction *func = compiler->compile("fun f(a, b) { return (a - b) * (a - b); }");
+    OPTIMIZATION_LEVEL = 1;
+    ASSERT_TRUE(func);
+    
+    ObjFunction* f = ValueOP::as_function(func->chunk.constants.values[0]);
+    EXPECT_EQ(f->chunk.count, 8);
+    EXPECT_EQ(f->chunk.code[4], OP_SUBTRACT);
+    EXPECT_EQ(f->chunk.code[5], OP_DUP);
+    EXPECT_EQ(f->chunk.code[6], OP_MULTIPLY);
+}
+
+TEST_F(Compiler_test, optimizer_common_subexpression_block) {
+    OPTIMIZATION_LEVEL = 2;
+    ObjFunction *func = compiler->compile("fun f(a, b) { var x = a * b; print x - a * b; b = 1; return x - a * b; }");
+    OPTIMIZATION_LEVEL = 1;
+    ASSERT_TRUE(func);
+    
+    //The first repeat reads the product back from x, the assignment to b makes the second one compute it again
+    Chunk& chunk = ValueOP::as_function(func->chunk.constants.values[0])->chunk;
+    EXPECT_EQ(chunk.code[5], OP_GET_LOCAL);
+    EXPECT_EQ(chunk.code[7], OP_GET_LOCAL);
+    EXPECT_EQ(chunk.code[8], 3);
+    EXPECT_EQ(chunk.code[9], OP_SUBTRACT);
+    EXPECT_EQ(std::count(chunk.code.begin(), chunk.code.end(), OP_MULTIPLY), 2);
+}
+
+TEST_F(Compiler_test, switch_table_dense) {
+    ObjFunction *func = compiler->compile("switch (a) { case 1 : print 1; break; case 2 : print 2; break; case 4 : print 4; }");
+    ASSERT_TRUE(func);
+    
+    ASSERT_EQ(func->chunk.switchTables.size(), 1);
+    const SwitchTable& table = func->chunk.switchTables[0];
+    EXPECT_EQ(table.low, 1);
+    ASSERT_EQ(table.dense.size(), 4);
+    EXPECT_EQ(table.dense[2], table.otherwise);
+    EXPECT_EQ(table.lookup(ValueOP::number_val(5)), table.otherwise);
+    EXPECT_NE(table.lookup(ValueOP::number_val(4)), table.otherwise);
+}
+
+TEST_F(Compiler_test, switch_table_not_literal) {
+    ObjFunction *func = compiler->compile("switch (a) { case a : print 1; case \"b\" : print 2; }");
+    ASSERT_TRUE(func);
+    
+    EXPECT_TRUE(func->chunk.switchTables.empty());
+}
+
+TEST_F(Compiler_test, switch_continue) {
+    testing::internal::CaptureStdout();
+    InterpretResult result = vm->interpret("var j = 0; while (j < 3) { j = j + 1; switch (j) { case 1: { var k = j; continue; } default: print j; } }");
+    
+    //continue leaves the switch for the next iteration of the loop instead of dispatching again
+    EXPECT_EQ(result, INTERPRET_OK);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "2\n3\n");
+    
+    EXPECT_FALSE(compiler->compile("switch (1) { case 1: continue; }"));
+}
+
+TEST_F(Compiler_test, capture_by_value) {
+    ObjFunction *func = compiler->compile("fun f(a, b) { fun g() { return a + b; } b = 1; return g; }");
+    ASSERT_TRUE(func);
+    
+    //a is never assigned and is copied into the closure, b is shared through an upvalue
+    ObjFunction* f = ValueOP::as_function(func->chunk.constants.values[0]);
+    ASSERT_EQ(f->chunk.code[0], OP_CLOSURE);
+    EXPECT_EQ(f->chunk.code[2], CAPTURE_LOCAL | CAPTURE_BY_VALUE);
+    EXPECT_EQ(f->chunk.code[3], 1);
+    EXPECT_EQ(f->chunk.code[4], CAPTURE_LOCAL);
+    EXPECT_EQ(f->chunk.code[5], 2);
+}
+
+TEST_F(Compiler_test, inline_small_function) {
+    OPTIMIZATION_LEVEL = 2;
+    ObjFunction *func = compiler->compile("fun add(a, b) { return a + b; } print add(a, 2);");
+    OPTIMIZATION_LEVEL = 1;
+    ASSERT_TRUE(func);
+    
+    Chunk& chunk = func->chunk;
+    auto guard = std::find(chunk.code.begin(), chunk.code.end(), OP_INLINE_GUARD);
+    ASSERT_NE(guard, chunk.code.end());
+    EXPECT_EQ(guard[1], 2);
+    EXPECT_EQ(ValueOP::as_function(chunk.constants.values[guard[2]]), ValueOP::as_function(chunk.constants.values[0]));
+    EXPECT_NE(std::find(guard, chunk.code.end(), OP_SLIDE), chunk.code.end());
+}
+
+TEST_F(Compiler_test, inline_jump_range) {
+    std::string source = "fun f(a, b) { return a * b + a - b * a + b; } var s = 0; for(var i = 0; i < 2; i = i + 1) {";
+    for(int i = 0; i < 1800; i++) source += " s = s + f(i, i);";
+    source += " } print s;";
+    
+    //Inlining every call would push the loop's jumps past 16 bits, so the calls are kept
+    OPTIMIZATION_LEVEL = 2;
+    testing::internal::CaptureStdout();
+    InterpretResult result = vm->interpret(source);
+    OPTIMIZATION_LEVEL = 1;
+    
+    EXPECT_EQ(result, INTERPRET_OK);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "3600\n");
+}
+
+TEST_F(Compiler_test, inline_stack_trace) {
+    OPTIMIZATION_LEVEL = 2;
+    testing::internal::CaptureStderr();
+    InterpretResult result = vm->interpret("fun add(a, b) {\n return a + b;\n}\nfun caller() {\n var x = 1;\n var y = add(x, \"s\");\n return y;\n}\ncaller();");
+    OPTIMIZATION_LEVEL = 1;
+    
+    //The error happens in the copy of add inside caller, which still shows up as a frame of its own
+    EXPECT_EQ(result, INTERPRET_RUNTIME_ERROR);
+    std::string trace = testing::internal::GetCapturedStderr();
+    EXPECT_NE(trace.find("[line 2] in add()\n[line 6] in caller()\n[line 9] in script\n"), std::string::npos);
+}
+
+TEST_F(Compiler_test, optimizer_infer_types) {
+    OPTIMIZATION_LEVEL = 2;
+    ObjFunction *func = compiler->compile("fun f(a) { var i = 0; while(i < 10) i = i + 1; return i + a; }");
+    OPTIMIZATION_LEVEL = 1;
+    ASSERT_TRUE(func);
+    
+    //The loop counter is always a whole number, the parameter could be anything
+    Chunk& chunk = ValueOP::as_function(func->chunk.constants.values[0])->chunk;
+    EXPECT_EQ(chunk.code[6], OP_LESS_INT);
+    EXPECT_EQ(chunk.code[15], OP_ADD_INT);
+    EXPECT_EQ(chunk.code[27], OP_ADD);
+}
+
+TEST_F(Compiler_test, tail_call) {
+    ObjFunction *func = compiler->compile("fun f(n) { if(n > 0) return f(n - 1); return g(n) + 1; }");
+    ASSERT_TRUE(func);
+    
+    Chunk& chunk = ValueOP::as_function(func->chunk.constants.values[0])->chunk;
+    auto tail = std::find(chunk.code.begin(), chunk.code.end(), OP_TAIL_CALL);
+    ASSERT_NE(tail, chunk.code.end());
+    EXPECT_EQ(tail[2], OP_RETURN);
+    EXPECT_EQ(std::count(chunk.code.begin(), chunk.code.end(), OP_TAIL_CALL), 1);
+    EXPECT_NE(std::find(chunk.code.begin(), chunk.code.end(), OP_CALL), chunk.code.end());
+}
+
+TEST_F(Compiler_test, compile_interpolation) {
+    ObjFunction *func = compiler->compile("`a${1}b`;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_EQ(func->chunk.code[6], OP_BUILD_STRING);
+    EXPECT_EQ(func->chunk.code[7], 3);
+}
+
+TEST_F(Compiler_test, compile_number_literals) {
+    ObjFunction *func = compiler->compile("0xFF; 0b11; 1e3;");
+    ASSERT_TRUE(func);
+    
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[0]) == Number(255));
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[1]) == Number(3));
+    EXPECT_TRUE(ValueOP::as_number(func->chunk.constants.values[2]) == Number(1000.0));
+}
+
 
 int main(int argc, char *argv[]) {
     testing::InitGoogleTest(&argc, argv);
@@ -1,22 +1,43 @@
 #include "util.hpp"
+#include <fcntl.h>
+#include <sys/stat.h>
 
 std::string readFile(const char* path) {
-    std::fstream file(path);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        std::string errormessage = "Cannot open file ";
+        errormessage += path;
+        throw errormessage;
+    }
+    
     std::string source;
-    std::string line;
+    struct stat info;
     
-    if(file.is_open()) {
-        while(getline(file, line)) {
-            source += line;
-            source += '\n';
+    //Regular files are read with a single sized read into a buffer one byte larger than the file,
+    //so the read that reports end of file needs no more room. Pipes and terminals have no size and grow in chunks
+    const size_t chunk = 1 << 16;
+    if(fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        source.resize((size_t)info.st_size + 1);
+    }
+    
+    size_t length = 0;
+    for(;;) {
+        if(length == source.size()) source.resize(length + chunk);
+        
+        ssize_t count = read(fd, &source[length], source.size() - length);
+        if(count < 0 && errno == EINTR) continue;
+        if(count < 0) {
+            close(fd);
+            std::string errormessage = "Cannot read file ";
+            errormessage += path;
+            throw errormessage;
         }
+        if(count == 0) break;
         
-        file.close();
-    } else {
-        std::string errormessage = "Cannot open file ";
-        errormessage += path;
-        throw errormessage;
+        length += (size_t)count;
     }
     
+    close(fd);
+    source.resize(length);
     return source;
 }
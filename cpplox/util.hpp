@@ -3,6 +3,9 @@
 
 #include "pch.pch"
 
+/// Read a whole file into a string with as few copies as possible. Line endings are kept as they are.
+/// Throws an error message if the file cannot be opened or read.
+/// @param path Path of the file, may also be a pipe or a device such as /dev/stdin
 std::string readFile(const char* path);
 
 template <typename T>
@@ -157,35 +157,35 @@ void ValueOP::setConst(bool isCon, Value value) {
 #endif
 
 
-void ValueOP::printValue(Value value) {
+void ValueOP::printValue(Value value, std::ostream& out) {
 #ifdef NAN_BOXING
     if (is_bool(value)) {
-        std::cout << (as_bool(value) ? "true" : "false");
+        out << (as_bool(value) ? "true" : "false");
     } else if (is_nul(value)) {
-        std::cout << "nul";;
+        out << "nul";;
     } else if (is_number(value)) {
-        std::cout << as_number(value);;
+        out << as_number(value);;
     } else if (is_obj(value)) {
-        printObject(value);
+        printObject(value, out);
     }
     
 #else
     switch (value.type) {
         case VAL_BOOL:
-            std::cout << (as_bool(value) ? "true" : "false");
+            out << (as_bool(value) ? "true" : "false");
             break;
         case VAL_NUL:
-            std::cout << "nul";
+            out << "nul";
             break;
         case VAL_NUMBER: {
-            std::cout << as_number(value);
+            out << as_number(value);
             break;
         }
         case VAL_OBJ:
-            printObject(value);
+            printObject(value, out);
             break;
         case VAL_EMPTY:
-            std::cout << "empty";
+            out << "empty";
             break;
     }
 #endif
@@ -197,7 +197,7 @@ bool ValueOP::valuesEqual(Value a, Value b) {
         return as_number(a) == as_number(b);
     }
     
-    return a == b;
+    return a == b || (is_obj(a) && is_obj(b) && stringsEqual(a, b));
 #else
     if (a.type != b.type) return false;
     
@@ -209,15 +209,25 @@ bool ValueOP::valuesEqual(Value a, Value b) {
         case VAL_NUMBER:
             return ValueOP::as_number(a) == ValueOP::as_number(b);
         case VAL_OBJ:
-            return as_obj(a) == as_obj(b); // covers string as all strings are interned
+            if(as_obj(a) == as_obj(b)) return true; // covers string as all strings are interned
+            return stringsEqual(a, b);
         default:
             return false; //unreachable
     }
 #endif
 }
 
+bool ValueOP::stringsEqual(Value a, Value b) {
+    if(!is_string(a) || !is_string(b) || string_length(a) != string_length(b)) return false;
+    
+    //Distinct interned strings always differ, anything else is compared by its characters
+    if(isObjType(a, OBJ_STRING) && isObjType(b, OBJ_STRING) && as_string(a)->interned && as_string(b)->interned) return false;
+    
+    return as_string_view(a) == as_string_view(b);
+}
+
 bool ValueOP::is_string(Value value) {
-    return isObjType(value, OBJ_STRING);
+    return is_obj(value) && (as_obj(value)->type == OBJ_STRING || as_obj(value)->type == OBJ_ROPE || as_obj(value)->type == OBJ_SLICE);
 }
 
 bool ValueOP::isObjType(Value value, ObjType type) {
@@ -229,47 +239,77 @@ ObjType ValueOP::obj_type(Value value) {
 }
 
 ObjString* ValueOP::as_string(Value value) {
-    return (ObjString*)as_obj(value);
+    Obj* object = as_obj(value);
+    if(object->type == OBJ_ROPE) return ((ObjRope*)object)->flatten();
+    if(object->type == OBJ_SLICE) return ((ObjSlice*)object)->materialize();
+    
+    return (ObjString*)object;
+}
+
+std::string_view ValueOP::as_string_view(Value value) {
+    if(isObjType(value, OBJ_SLICE)) return as_slice(value)->view();
+    
+    return as_string(value)->view();
 }
 
-std::string* ValueOP::as_std_string(Value value) {
-    return &((ObjString*)as_obj(value))->chars;
+ObjSlice* ValueOP::as_slice(Value value) {
+    return (ObjSlice*)as_obj(value);
 }
 
-void ValueOP::printObject(Value value) {
+ObjString* ValueOP::intern_string(Value value, VM* vm) {
+    //Slices are copied straight into the interned string instead of being materialized first
+    if(isObjType(value, OBJ_SLICE)) return ObjString::copyString(vm, as_slice(value)->view());
+    
+    return as_string(value)->intern(vm);
+}
+
+size_t ValueOP::string_length(Value value) {
+    Obj* object = as_obj(value);
+    if(object->type == OBJ_ROPE) return ((ObjRope*)object)->length;
+    if(object->type == OBJ_SLICE) return ((ObjSlice*)object)->length;
+    
+    return ((ObjString*)object)->length;
+}
+
+void ValueOP::printObject(Value value, std::ostream& out) {
     switch(obj_type(value)) {
         case OBJ_BOUND_METHOD:
-            printFunction(get_value_function(value));
+            printFunction(get_value_function(value), out);
             break;
         case OBJ_STRING:
-            std::cout << *as_std_string(value);
+        case OBJ_ROPE:
+        case OBJ_SLICE:
+            out << as_string_view(value);
             break;
         case OBJ_FUNCTION:
-            printFunction(as_function(value));
+            printFunction(as_function(value), out);
             break;
         case OBJ_NATIVE:
-            std::cout << "<native fn>";
+            out << "<native fn>";
             break;
         case OBJ_CLOSURE:
-            printFunction(as_closure(value)->function);
+            printFunction(as_closure(value)->function, out);
             break;
         case OBJ_UPVALUE:
-            std::cout << "upvalue";
+            out << "upvalue";
             break;
         case OBJ_CLASS:
-            std::cout << as_class(value)->name->chars;
+            out << as_class(value)->name->chars();
             break;
         case OBJ_INSTANCE:
-            std::cout << as_instance(value)->_class->name->chars << " instance";
+            out << as_instance(value)->_class->name->chars() << " instance";
             break;
         case OBJ_NATIVE_CLASS_METHOD:
-            std::cout << "native class method";
+            out << "native class method";
             break;
         case OBJ_NATIVE_CLASS: {
             ObjNativeClass* _class = as_native_class(value);
             switch (_class->subType) {
                 case NATIVE_COLLECTION:
-                    std::cout << "Collection Class";
+                    out << "Collection Class";
+                    break;
+                case NATIVE_STRING_BUILDER:
+                    out << "StringBuilder Class";
                     break;
             }
             break;
@@ -279,24 +319,28 @@ void ValueOP::printObject(Value value) {
             switch (instance->subType) {
                 case NATIVE_COLLECTION_INSTANCE: {
                     ObjCollectionInstance* collection = static_cast<ObjCollectionInstance*>(instance);
-                    std::cout << "{";
+                    out << "{";
                     for(int i = 0; i < collection->values.count; i++) {
-                        printValue(collection->values.values[i]);
-                        if(i != collection->values.count - 1) std::cout << ", ";
+                        printValue(collection->values.values[i], out);
+                        if(i != collection->values.count - 1) out << ", ";
                     }
-                    std::cout << "}";
+                    out << "}";
+                    break;
                 }
+                case NATIVE_STRING_BUILDER_INSTANCE:
+                    out << static_cast<ObjStringBuilderInstance*>(instance)->buffer;
+                    break;
             }
         }
     }
 }
 
-void ValueOP::printFunction(ObjFunction *function) {
+void ValueOP::printFunction(ObjFunction *function, std::ostream& out) {
     if(function->name == nullptr) {
-        std::cout << "<script>";
+        out << "<script>";
         return;
     }
-    std::cout << "<fn " << function->name->chars << ">";
+    out << "<fn " << function->name->chars() << ">";
 }
 
 
@@ -319,7 +363,7 @@ uint32_t ValueOP::hashValue(Value value) {
     } else if (is_nul(value)) {
         return 8;
     } else if (is_obj(value)) {
-        return as_string(value)->hash;
+        return isObjType(value, OBJ_SLICE) ? ObjString::hashString(as_slice(value)->view().data(), as_slice(value)->length) : as_string(value)->getHash();
     } else {
         return 0;
     }
@@ -328,7 +372,7 @@ uint32_t ValueOP::hashValue(Value value) {
         case VAL_BOOL: return as_bool(value) ? 3 : 4;
         case VAL_NUL: return 8;
         case VAL_NUMBER: return hashNumber(as_number(value));
-        case VAL_OBJ: return as_string(value)->hash;
+        case VAL_OBJ: return isObjType(value, OBJ_SLICE) ? ObjString::hashString(as_slice(value)->view().data(), as_slice(value)->length) : as_string(value)->getHash();
         case VAL_EMPTY: return 0;
     }
 #endif
@@ -432,92 +476,115 @@ ObjNativeClass* ValueOP::as_native_class(Value value) {
 }
 
 ObjString* ValueOP::to_string(Value value, VM* vm) {
+    if(is_string(value)) return as_string(value);
+    
+    std::string buffer;
+    append_string(value, buffer);
+    return ObjString::newString(vm, buffer);
+}
+
+void ValueOP::append_string(Value value, std::string& buffer) {
     switch (value.type) {
-        case VAL_BOOL: {
-            return ObjString::copyString(vm, value.as.boolean ? "true" : "false");
-        }
-        case VAL_NUL: {
-            return ObjString::copyString(vm, "nul");
-        }
+        case VAL_BOOL:
+            buffer += value.as.boolean ? "true" : "false";
+            break;
+        case VAL_NUL:
+            buffer += "nul";
+            break;
         case VAL_NUMBER: {
-            std::stringstream ss;
-            ss << value.as.number;
-            return ObjString::copyString(vm, ss.str());
-        }
-        case VAL_OBJ: {
-            return object_to_string(value, vm);
-        }
-        default: {
-            return ObjString::copyString(vm, "");
+            char text[Number::MAX_CHARS];
+            buffer.append(text, value.as.number.toChars(text) - text);
+            break;
         }
+        case VAL_OBJ:
+            append_object(value, buffer);
+            break;
+        default:
+            break;
     }
 }
 
-ObjString* ValueOP::object_to_string(Value value, VM* vm) {
+void ValueOP::append_object(Value value, std::string& buffer) {
     switch(obj_type(value)) {
         case OBJ_FUNCTION:
         case OBJ_BOUND_METHOD:
-            return function_to_string(get_value_function(value), vm);
+        case OBJ_CLOSURE:
+            append_function(get_value_function(value), buffer);
+            break;
         case OBJ_STRING:
-            return as_string(value);
+            buffer += as_string(value)->view();
+            break;
+        case OBJ_ROPE:
+            ((ObjRope*)as_obj(value))->appendTo(buffer);
+            break;
+        case OBJ_SLICE:
+            buffer += as_slice(value)->view();
+            break;
         case OBJ_NATIVE:
-            return ObjString::copyString(vm, "<native fn>");
-        case OBJ_CLOSURE:
-            return function_to_string(get_value_function(value), vm);
+            buffer += "<native fn>";
+            break;
         case OBJ_UPVALUE:
-            return ObjString::copyString(vm, "upvalue");
+            buffer += "upvalue";
+            break;
         case OBJ_CLASS:
-            return ObjString::copyString(vm, as_class(value)->name->chars);
-        case OBJ_INSTANCE: {
-            std::string buffer(as_instance(value)->_class->name->chars);
+            buffer += as_class(value)->name->view();
+            break;
+        case OBJ_INSTANCE:
+            buffer += as_instance(value)->_class->name->view();
             buffer += " instance";
-            return ObjString::copyString(vm, buffer);
-        }
+            break;
         case OBJ_NATIVE_CLASS: {
             ObjNativeClass* _class = ValueOP::as_native_class(value);
             switch(_class->subType) {
                 case NATIVE_COLLECTION:
-                    return ObjString::copyString(vm, "Collection Class");
+                    buffer += "Collection Class";
+                    break;
+                case NATIVE_STRING_BUILDER:
+                    buffer += "StringBuilder Class";
+                    break;
                 default:
-                    return ObjString::copyString(vm, "Native Class");
+                    buffer += "Native Class";
+                    break;
             }
+            break;
         }
         case OBJ_NATIVE_INSTANCE: {
             ObjNativeInstance* instance = ValueOP::as_native_instance(value);
             switch (instance->subType) {
                 case NATIVE_COLLECTION_INSTANCE: {
                     ObjCollectionInstance* collection = static_cast<ObjCollectionInstance*>(instance);
-                    std::string buffer;
                     for(int i = 0; i < collection->values.count; i++) {
-                        vm->push_stack(ValueOP::obj_val(to_string(collection->values.values[i], vm)));
-                        buffer += as_string(vm->peek(0))->chars;
-                        vm->stack.pop_back();
+                        append_string(collection->values.values[i], buffer);
                     }
-                    
-                    return ObjString::copyString(vm, buffer);
+                    break;
                 }
+                case NATIVE_STRING_BUILDER_INSTANCE:
+                    buffer += static_cast<ObjStringBuilderInstance*>(instance)->buffer;
+                    break;
                 default:
-                    return ObjString::copyString(vm, "Native Instance");
+                    buffer += "Native Instance";
+                    break;
             }
+            break;
         }
         default: {
-            Obj* object = as_obj(value);
             std::stringstream ss;
-            ss << ((void *)object);
-            return ObjString::copyString(vm, ss.str());
+            ss << ((void *)as_obj(value));
+            buffer += ss.str();
+            break;
         }
     }
 }
 
-ObjString* ValueOP::function_to_string(ObjFunction* function, VM* vm) {
+void ValueOP::append_function(ObjFunction* function, std::string& buffer) {
     if(function->name == nullptr) {
-        return ObjString::copyString(vm, "<script>");
+        buffer += "<script>";
+        return;
     }
     
-    std::string buffer = "<fn ";
-    buffer += std::string(function->name->chars);
+    buffer += "<fn ";
+    buffer += function->name->view();
     buffer += ">";
-    return ObjString::copyString(vm, buffer.c_str());
 }
 
 ObjNativeInstance* ValueOP::as_native_instance(Value value) {
@@ -8,6 +8,7 @@
 
 class Obj;
 class ObjString;
+class ObjSlice;
 class ObjFunction;
 class ObjNative;
 class ObjClosure;
@@ -77,12 +78,20 @@ bool is_native_subinstance(Value value, NativeInstanceType type);
 bool is_native_method(Value value);
 bool isObjType(Value value, ObjType type);
 bool isConst(Value value);
+/// Compare strings, ropes and transient strings by their characters
+bool stringsEqual(Value a, Value b);
 
 bool as_bool(Value value);
 Number as_number(Value value);
 Obj* as_obj(Value value);
 ObjString* as_string(Value value);
-std::string* as_std_string(Value value);
+/// Characters of a string, rope or slice, without materializing the slice
+std::string_view as_string_view(Value value);
+ObjSlice* as_slice(Value value);
+/// Get the interned string with the characters of a string, rope or slice
+ObjString* intern_string(Value value, VM* vm);
+/// Number of characters of a string, rope or slice, without flattening the rope
+size_t string_length(Value value);
 ObjFunction* as_function(Value value);
 ObjNative* as_native(Value value);
 ObjClosure* as_closure(Value value);
@@ -101,9 +110,12 @@ T* as_native_subinstance(Value value) {
 }
 ObjNativeClassMethod* as_native_class_method(Value value);
 
+/// Get the text of a value as an interned string. Strings are returned as they are.
 ObjString* to_string(Value value, VM* vm);
-ObjString* object_to_string(Value object, VM* vm);
-ObjString* function_to_string(ObjFunction* function, VM* vm);
+/// Append the text of a value to a buffer without creating any string object
+void append_string(Value value, std::string& buffer);
+void append_object(Value object, std::string& buffer);
+void append_function(ObjFunction* function, std::string& buffer);
 
 Value bool_val(bool value);
 Value nul_val();
@@ -114,9 +126,9 @@ Value empty_val();
 bool valuesEqual(Value a, Value b);
 
 ObjType obj_type(Value value);
-void printObject(Value value);
-void printValue(Value value);
-void printFunction(ObjFunction* function);
+void printObject(Value value, std::ostream& out = std::cout);
+void printValue(Value value, std::ostream& out = std::cout);
+void printFunction(ObjFunction* function, std::ostream& out = std::cout);
 uint32_t hashValue(Value value);
 
 ObjFunction* get_value_function(Value value);
@@ -24,7 +24,7 @@ bool VM::interpolateNative(int argCount, Value *args) {
     }
     
     ObjString* format = ValueOP::as_string(args[0]);
-    size_t n = format->chars.length();
+    size_t n = format->length;
     
     ObjCollectionInstance* input = ValueOP::as_native_subinstance<ObjCollectionInstance>(args[1]);
     size_t m = input->values.count;
@@ -33,26 +33,21 @@ bool VM::interpolateNative(int argCount, Value *args) {
     int j = 0;
     int i = 0;
     while(i < n) {
-        if(format->chars[i] == '$' && i != n - 2 && format->chars[i + 1] == '{' && format->chars[i + 2] == '}') {
+        if(format->chars()[i] == '$' && i != n - 2 && format->chars()[i + 1] == '{' && format->chars()[i + 2] == '}') {
             if(j >= m) {
                 args[-1] = ValueOP::obj_val(ObjString::copyString(this, "Expected more arguments for interpolation."));
                 return false;
             }
             
-            ObjString* arg = ValueOP::to_string(input->values.values[j++], this);
-            push_stack(ValueOP::obj_val(arg));
-            std::string inserted(arg->chars);
-            interloped += inserted;
-            stack.pop_back();
-            
+            ValueOP::append_string(input->values.values[j++], interloped);
             i += 3;
         } else {
-            interloped += format->chars[i];
+            interloped += format->chars()[i];
             i++;
         }
     }
     
-    args[-1] = ValueOP::obj_val(ObjString::copyString(this, interloped));
+    args[-1] = ValueOP::obj_val(ObjString::newString(this, interloped));
     return true;
 }
 
@@ -68,15 +63,17 @@ bool VM::errNative(int argCount, Value* args) {
 
 bool VM::runtimeErrNative(int argCount, Value *args) {
     ObjString* errMessage = ValueOP::as_string(args[0]);
-    args[-1] = ValueOP::obj_val(ObjString::copyString(this, errMessage->chars));
+    args[-1] = ValueOP::obj_val(ObjString::copyString(this, errMessage->view()));
     return false;
 }
 
 bool VM::getLineNative(int argCount, Value *args) {
+    //Show any prompt printed before waiting for input
+    outputBuffer.flush();
     try {
         std::string get;
         getline(std::cin, get);
-        args[-1] = ValueOP::obj_val(ObjString::copyString(this, get));
+        args[-1] = ValueOP::obj_val(ObjString::newString(this, get));
         return true;
     } catch(std::exception& e) {
         args[-1] = ValueOP::obj_val(ObjString::copyString(this, e.what()));
@@ -84,6 +81,12 @@ bool VM::getLineNative(int argCount, Value *args) {
     }
 }
 
+bool VM::flushNative(int argCount, Value* args) {
+    outputBuffer.flush();
+    args[-1] = ValueOP::nul_val();
+    return true;
+}
+
 bool VM::hasFieldNative(int argCount, Value* args) {
     if(!ValueOP::is_instance(args[0])) {
         args[-1] = ValueOP::obj_val(ObjString::copyString(this, "Expected first argument to be a class instance."));
@@ -133,7 +136,33 @@ bool VM::setFieldNative(int argCount, Value *args) {
 
 //====================================================================>
 
-VM::VM() : strings(this), globalNames(this), globalValues(this){
+OutputBuffer::OutputBuffer() {
+    lineBuffered = isatty(STDOUT_FILENO);
+    setp(buffer, buffer + OUTPUT_BUFFER_SIZE);
+}
+
+void OutputBuffer::flush() {
+    //Goes through stdio so that output written to std::cout directly, like traces, stays in order
+    if(pptr() > pbase()) fwrite(pbase(), 1, pptr() - pbase(), stdout);
+    fflush(stdout);
+    setp(buffer, buffer + OUTPUT_BUFFER_SIZE);
+}
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c) {
+    flush();
+    if(!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int OutputBuffer::sync() {
+    flush();
+    return 0;
+}
+
+VM::VM() : strings(this), globalNames(this), globalValues(this), stringMethods(this), output(&outputBuffer) {
     current = nullptr;
     currentClass = nullptr;
     objects = nullptr;
@@ -149,6 +178,7 @@ VM::VM() : strings(this), globalNames(this), globalValues(this){
     defineNative("error", &VM::errNative, 0);
     defineNative("runtimeError", &VM::runtimeErrNative, 1);
     defineNative("getLine", &VM::getLineNative, 0);
+    defineNative("flush", &VM::flushNative, 0);
     defineNative("hasField", &VM::hasFieldNative, 2);
     defineNative("getField", &VM::getFieldNative, 2);
     defineNative("setField", &VM::setFieldNative, 3);
@@ -157,7 +187,25 @@ VM::VM() : strings(this), globalNames(this), globalValues(this){
     defineNative("isFloat", &VM::isFloatNative, 1);
     defineNative("isWhole", &VM::isWholeNative, 1);
     
+    defineNative("indexOf", &VM::indexOfNative, 2);
+    defineNative("contains", &VM::containsNative, 2);
+    defineNative("split", &VM::splitNative, 2);
+    defineNative("replace", &VM::replaceNative, 3);
+    defineNative("join", &VM::joinNative, 2);
+    defineNative("trim", &VM::trimNative, 1);
+    defineNative("upper", &VM::upperNative, 1);
+    defineNative("lower", &VM::lowerNative, 1);
+    defineNative("repeat", &VM::repeatNative, 2);
+    
     defineNativeClass("Collection", NATIVE_COLLECTION);
+    defineNativeClass("StringBuilder", NATIVE_STRING_BUILDER);
+    
+    defineStringMethod("length", &VM::stringLengthNative, 0);
+    defineStringMethod("indexAccess", &VM::stringIndexNative, 1);
+    defineStringMethod("slice", &VM::stringSliceNative, 2);
+    defineStringMethod("find", &VM::stringFindNative, 1);
+    defineStringMethod("startsWith", &VM::stringStartsWithNative, 1);
+    defineStringMethod("split", &VM::stringSplitNative, 1);
 }
 
 void VM::resetStacks() {
@@ -201,24 +249,68 @@ InterpretResult VM::binary_op(Value (*valuetype)(T),std::function<T (U, U)> func
     return INTERPRET_OK;
 }
 
+template <typename F>
+bool VM::bitwise_op(F func, bool shift) {
+    if(!ValueOP::is_number(peek(0)) || !ValueOP::is_number(peek(1)) ||
+       !ValueOP::is_whole_number(peek(0)) || !ValueOP::is_whole_number(peek(1))) {
+        runtimeError("Operands must be whole numbers.");
+        return false;
+    }
+    
+    Number b = ValueOP::as_number(stack.back());
+    if(shift && (b.number.whole < 0 || b.number.whole > 63)) {
+        runtimeError("Shift count must be between 0 and 63.");
+        return false;
+    }
+    
+    stack.pop_back();
+    stack.back() = ValueOP::number_val(func(ValueOP::as_number(stack.back()), b));
+    return true;
+}
+
+template <typename F, typename G>
+void VM::whole_op(F checked, G fallback) {
+    Number b = ValueOP::as_number(stack.back());
+    stack.pop_back();
+    Number a = ValueOP::as_number(stack.back());
+    
+    long long result;
+    if(!a.is_float && !b.is_float && !checked(a.number.whole, b.number.whole, &result)) {
+        stack.back() = ValueOP::number_val(Number::gen_whole_num(result));
+    } else {
+        stack.back() = ValueOP::number_val(fallback(a, b));
+    }
+}
+
+template <typename T, typename F>
+void VM::number_op(Value (*valuetype)(T), F func) {
+    Number b = ValueOP::as_number(stack.back());
+    stack.pop_back();
+    Number a = ValueOP::as_number(stack.back());
+    stack.back() = valuetype(func(a, b));
+}
+
 void VM::freeVM() {
+    outputBuffer.flush();
     initString = nullptr;
     freeObjects(this);
 }
 
-InterpretResult VM::interpret(const std::string& source) {
+InterpretResult VM::interpret(std::string source) {
     Scanner scanner;
     Parser parser(&scanner);
     
     Compiler compiler(this, TYPE_SCRIPT, nullptr, &scanner, &parser, EXECUTION_PATH);
-    ObjFunction* function = compiler.compile(source);
+    ObjFunction* function = compiler.compile(std::move(source));
     
     if(function == nullptr) return INTERPRET_COMPILE_ERROR;
     
     push_stack(ValueOP::obj_val(function));
     callValue(ValueOP::obj_val(function), 0);
     
-    return run();
+    InterpretResult result = run();
+    outputBuffer.flush();
+    return result;
 }
 
 
@@ -262,11 +354,11 @@ InterpretResult VM::run() {
                 break;
             }
             case OP_EQUAL: {
-                Value b = stack.back();
+                //Comparing ropes flattens them, so the operands stay on the stack until then
+                bool equal = ValueOP::valuesEqual(peek(1), peek(0));
                 stack.pop_back();
-                Value a = stack.back();
                 stack.pop_back();
-                push_stack(ValueOP::bool_val(ValueOP::valuesEqual(a,b)));
+                push_stack(ValueOP::bool_val(equal));
                 break;
             }
             case OP_GREATER: {
@@ -295,6 +387,47 @@ InterpretResult VM::run() {
                 binary_op<Number,Number>(ValueOP::number_val, std::divides<Number>());
                 break;
             }
+            case OP_MODULO:
+            case OP_INT_DIVIDE: {
+                if(ValueOP::is_number(peek(0)) && ValueOP::is_whole_number(peek(0)) && ValueOP::as_number(peek(0)).number.whole == 0 &&
+                   ValueOP::is_number(peek(1)) && ValueOP::is_whole_number(peek(1))) {
+                    runtimeError("Division by zero.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                
+                InterpretResult result = instruction == OP_MODULO ?
+                    binary_op<Number,Number>(ValueOP::number_val, std::modulus<Number>()) :
+                    binary_op<Number,Number>(ValueOP::number_val, intDivide);
+                if(result != INTERPRET_OK) return result;
+                break;
+            }
+            case OP_BIT_AND:
+                if(!bitwise_op(std::bit_and<Number>())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_BIT_OR:
+                if(!bitwise_op(std::bit_or<Number>())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_BIT_XOR:
+                if(!bitwise_op(std::bit_xor<Number>())) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_SHIFT_LEFT:
+                if(!bitwise_op(shiftLeft, true)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_SHIFT_RIGHT:
+                if(!bitwise_op(shiftRight, true)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_SHIFT_RIGHT_UNSIGNED:
+                if(!bitwise_op(shiftRightUnsigned, true)) return INTERPRET_RUNTIME_ERROR;
+                break;
+            case OP_BIT_NOT: {
+                if(!ValueOP::is_number(peek(0)) || !ValueOP::is_whole_number(peek(0))) {
+                    runtimeError("Operand must be a whole number.");
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                
+                stack.back() = ValueOP::number_val(~ValueOP::as_number(stack.back()));
+                break;
+            }
             case OP_MULTIPLY: {
                 binary_op<Number,Number>(ValueOP::number_val, std::multiplies<Number>());
                 break;
@@ -303,6 +436,42 @@ InterpretResult VM::run() {
                 binary_op<Number,Number>(ValueOP::number_val, std::minus<Number>());
                 break;
             }
+            case OP_ADD_INT:
+                whole_op([](long long a, long long b, long long* result) { return __builtin_add_overflow(a, b, result); },
+                         std::plus<Number>());
+                break;
+            case OP_SUBTRACT_INT:
+                whole_op([](long long a, long long b, long long* result) { return __builtin_sub_overflow(a, b, result); },
+                         std::minus<Number>());
+                break;
+            case OP_MULTIPLY_INT:
+                whole_op([](long long a, long long b, long long* result) { return __builtin_mul_overflow(a, b, result); },
+                         std::multiplies<Number>());
+                break;
+            case OP_GREATER_INT:
+                number_op<bool>(ValueOP::bool_val, std::greater<Number>());
+                break;
+            case OP_LESS_INT:
+                number_op<bool>(ValueOP::bool_val, std::less<Number>());
+                break;
+            case OP_ADD_NUM:
+                number_op<Number>(ValueOP::number_val, std::plus<Number>());
+                break;
+            case OP_SUBTRACT_NUM:
+                number_op<Number>(ValueOP::number_val, std::minus<Number>());
+                break;
+            case OP_MULTIPLY_NUM:
+                number_op<Number>(ValueOP::number_val, std::multiplies<Number>());
+                break;
+            case OP_DIVIDE_NUM:
+                number_op<Number>(ValueOP::number_val, std::divides<Number>());
+                break;
+            case OP_GREATER_NUM:
+                number_op<bool>(ValueOP::bool_val, std::greater<Number>());
+                break;
+            case OP_LESS_NUM:
+                number_op<bool>(ValueOP::bool_val, std::less<Number>());
+                break;
             case OP_NOT: {
                 Value v = ValueOP::bool_val(isFalsey(stack.back()));
                 stack.pop_back();
@@ -362,9 +531,12 @@ InterpretResult VM::run() {
                     }
                 }
                 
-                ValueOP::printValue(stack.back());
+                ValueOP::printValue(stack.back(), output);
                 stack.pop_back();
-                std::cout << std::endl;
+                output.put('\n');
+                
+                //Traces go straight to std::cout, so flush to keep them in order with the output
+                if(outputBuffer.lineBuffered || DEBUG_TRACE_EXECUTION) outputBuffer.flush();
                 break;
             }
             case OP_POP:
@@ -408,6 +580,11 @@ InterpretResult VM::run() {
                 if (isFalsey(peek(0))) frame->ip += offset;
                 break;
             }
+            case OP_JUMP_IF_TRUE: {
+                uint16_t offset = read_short(frame);
+                if (!isFalsey(peek(0))) frame->ip += offset;
+                break;
+            }
             case OP_JUMP_IF_EMPTY: {
                 uint16_t offset = read_short(frame);
                 if (ValueOP::is_empty(peek(0))) frame->ip += offset;
@@ -423,6 +600,32 @@ InterpretResult VM::run() {
                 frame->ip -= offset;
                 break;
             }
+            case OP_INLINE_GUARD: {
+                //Inlined code assumes the callee it was copied from, anything else takes the call after it
+                uint8_t argCount = read_byte(frame);
+                Value callee = read_constant(frame);
+                uint16_t offset = read_short(frame);
+                if (!ValueOP::valuesEqual(peek(argCount), callee)) frame->ip += offset;
+                break;
+            }
+            case OP_BUILD_STRING:
+                buildString(read_byte(frame));
+                break;
+            case OP_SLIDE: {
+                Value result = stack.back();
+                stack.resize(stack.size() - read_byte(frame) - 1);
+                push_stack(result);
+                break;
+            }
+            case OP_SWITCH_TABLE: {
+                Chunk& chunk = getFrameFunction(frame)->chunk;
+                const SwitchTable& table = chunk.switchTables[read_short(frame)];
+                
+                //Case strings are interned and looked up by identity
+                if(ValueOP::is_string(peek(0))) stack.back() = ValueOP::obj_val(ValueOP::intern_string(peek(0), this));
+                frame->ip = chunk.code.data() + table.lookup(peek(0));
+                break;
+            }
             case OP_DUP:
                 push_stack(peek(0));
                 break;
@@ -434,15 +637,39 @@ InterpretResult VM::run() {
                 frame = &frames.back();
                 break;
             }
+            case OP_TAIL_CALL: {
+                int argCount = read_byte(frame);
+                
+                //Nothing of this frame is used anymore, the callee and its arguments move down to where it started
+                closeUpvalues(&stack[frame->slots]);
+                std::move(stack.end() - argCount - 1, stack.end(), stack.begin() + frame->slots);
+                stack.resize(frame->slots + argCount + 1);
+                
+                size_t depth = frames.size();
+                if(!callValue(peek(argCount), argCount)) {
+                    return INTERPRET_RUNTIME_ERROR;
+                }
+                
+                //A called function takes over the frame and returns straight to our caller. Natives and classes
+                //without an initializer leave their result where the frame started, for the OP_RETURN that follows.
+                if(frames.size() > depth) {
+                    frames[depth - 1] = frames.back();
+                    frames.pop_back();
+                }
+                frame = &frames.back();
+                break;
+            }
             case OP_CLOSURE: {
                 ObjFunction* function = ValueOP::as_function(read_constant(frame));
                 ObjClosure* closure = ObjClosure::newClosure(function, this);
                 push_stack(ValueOP::obj_val(closure));
                 for(int i = 0; i < closure->upvalueCount; i++) {
-                    uint8_t isLocal = read_byte(frame);
+                    uint8_t flags = read_byte(frame);
                     uint8_t index = read_byte(frame);
-                    if (isLocal) {
-                        closure->upvalues[i] = captureUpvalue(frame->slots + index);
+                    if (flags & CAPTURE_BY_VALUE) {
+                        closure->upvalues[i].value = stack[frame->slots + index];
+                    } else if (flags & CAPTURE_LOCAL) {
+                        closure->upvalues[i].upvalue = captureUpvalue(frame->slots + index);
                     } else {
                         closure->upvalues[i] = ((ObjClosure*)frame->function)->upvalues[index];
                     }
@@ -450,13 +677,17 @@ InterpretResult VM::run() {
                 break;
             }
             case OP_GET_UPVALUE: {
-                uint8_t slot = read_byte(frame);
-                push_stack(*((ObjClosure*)frame->function)->upvalues[slot]->location);
+                const Capture& capture = ((ObjClosure*)frame->function)->upvalues[read_byte(frame)];
+                push_stack(capture.upvalue != nullptr ? *capture.upvalue->location : capture.value);
                 break;
             }
             case OP_SET_UPVALUE: {
-                uint8_t slot = read_byte(frame);
-                *((ObjClosure*)frame->function)->upvalues[slot]->location = peek(0);
+                Capture& capture = ((ObjClosure*)frame->function)->upvalues[read_byte(frame)];
+                if(capture.upvalue != nullptr) {
+                    *capture.upvalue->location = peek(0);
+                } else {
+                    capture.value = peek(0);
+                }
                 break;
             }
             case OP_CLOSE_UPVALUE: {
@@ -518,7 +749,7 @@ InterpretResult VM::run() {
                     break;
                 }
                 
-                runtimeError("Undefined Property '%s'.", name->chars.c_str());
+                runtimeError("Undefined Property '%s'.", name->chars());
                 return INTERPRET_RUNTIME_ERROR;
             }
             case OP_METHOD: {
@@ -590,11 +821,8 @@ InterpretResult VM::run() {
                     ValueOP::as_number(stack.back()).number.decimal : ValueOP::as_number(stack.back()).number.whole;
                 stack.pop_back();
                 
-                Value collection_idx;
-                globalNames.tableGet(ValueOP::obj_val(ObjString::copyString(this, "Collection")), &collection_idx);
-                
-                ObjCollectionClass* collection_class = ValueOP::as_native_subclass<ObjCollectionClass>(globalValues.values[(long)(ValueOP::as_number(collection_idx).is_float ? ValueOP::as_number(collection_idx).number.decimal : ValueOP::as_number(collection_idx).number.whole)]);
-                ObjCollectionInstance* collection = ObjCollectionInstance::newCollectionInstance(collection_class, this);
+                ObjCollectionInstance* collection = newCollection();
+                ObjCollectionClass* collection_class = static_cast<ObjCollectionClass*>(collection->_class);
                 push_stack(ValueOP::obj_val(collection));
                 for(double i = start; (end > start) ? i < end : i > end; i += step) {
                     Value tobeinserted = ValueOP::number_val(i);
@@ -613,6 +841,8 @@ InterpretResult VM::run() {
 bool VM::invoke(ObjString *name, int argCount, bool interrupt) {
     Value receiver = peek(argCount);
     
+    if(ValueOP::is_string(receiver)) return invokeString(name, argCount, interrupt);
+    
     if(!ValueOP::is_instance(receiver) && !ValueOP::is_native_instance(receiver)) {
         runtimeError("Only instances have methods.");
         return false;
@@ -632,7 +862,7 @@ bool VM::invoke(ObjString *name, int argCount, bool interrupt) {
 bool VM::invokeFromClass(ObjClass *_class, ObjString *name, int argCount, bool interrupt) {
     Value method;
     if (!_class->methods.tableGet(ValueOP::obj_val(name), &method)) {
-        if(interrupt) runtimeError("Undefined property '%s'.", name->chars.c_str());
+        if(interrupt) runtimeError("Undefined property '%s'.", name->chars());
         return false;
     }
     
@@ -655,13 +885,26 @@ bool VM::invokeFromClass(ObjClass *_class, ObjString *name, int argCount, bool i
 }
 
 
-void VM::concatenate() {
-    ObjString* b = ValueOP::as_string(peek(0));
-    ObjString* a = ValueOP::as_string(peek(1));
+bool VM::invokeString(ObjString* name, int argCount, bool interrupt) {
+    Value method;
+    if(!stringMethods.tableGet(ValueOP::obj_val(name), &method)) {
+        if(interrupt) runtimeError("Undefined property '%s'.", name->chars());
+        return false;
+    }
     
-    std::string newString = a->chars + b->chars;
+    return callNative(ValueOP::as_native(method), argCount);
+}
+
+void VM::concatenate() {
+    size_t length = ValueOP::string_length(peek(1)) + ValueOP::string_length(peek(0));
     
-    ObjString* result = ObjString::copyString(this, newString.c_str());
+    //Long results become ropes, which are only copied once their characters are needed
+    Obj* result;
+    if(length < ROPE_MIN_LENGTH) {
+        result = ObjString::concatenate(this, ValueOP::as_string_view(peek(1)), ValueOP::as_string_view(peek(0)));
+    } else {
+        result = ObjRope::newRope(this, ValueOP::as_obj(peek(1)), ValueOP::as_obj(peek(0)), length);
+    }
     
     stack.pop_back();
     stack.pop_back();
@@ -670,6 +913,42 @@ void VM::concatenate() {
     push_stack(ValueOP::obj_val(result));
 }
 
+void VM::buildString(int count) {
+    //Strings are copied straight into the result, anything else is formatted into formatBuffer first,
+    //so that the exact length is known before the result is allocated
+    formatBuffer.clear();
+    size_t formattedEnd[UINT8_MAX + 1];
+    size_t length = 0;
+    for(int i = 0; i < count; i++) {
+        Value part = peek(count - 1 - i);
+        if(ValueOP::is_string(part)) {
+            //Flattens ropes now, as nothing may allocate once the result exists
+            length += ValueOP::as_string_view(part).size();
+        } else {
+            ValueOP::append_string(part, formatBuffer);
+            formattedEnd[i] = formatBuffer.size();
+        }
+    }
+    
+    ObjString* result = ObjString::allocateString(this, length + formatBuffer.size());
+    char* out = result->chars();
+    size_t formatted = 0;
+    for(int i = 0; i < count; i++) {
+        Value part = peek(count - 1 - i);
+        if(ValueOP::is_string(part)) {
+            std::string_view view = ValueOP::as_string_view(part);
+            memcpy(out, view.data(), view.size());
+            out += view.size();
+        } else {
+            memcpy(out, formatBuffer.data() + formatted, formattedEnd[i] - formatted);
+            out += formattedEnd[i] - formatted;
+            formatted = formattedEnd[i];
+        }
+    }
+    
+    stack.resize(stack.size() - count);
+    push_stack(ValueOP::obj_val(result));
+}
 
 bool VM::isFalsey(Value value) {
     return ValueOP::is_nul(value) || (ValueOP::is_bool(value) && !ValueOP::as_bool(value));
@@ -680,6 +959,8 @@ Value VM::peek(int distance) {
 }
 
 void VM::runtimeError(const std::string& format, ... ) {
+    outputBuffer.flush();
+    
     va_list args;
     va_start(args, format);
     std::cerr << "Runtime Error: ";
@@ -692,12 +973,20 @@ void VM::runtimeError(const std::string& format, ... ) {
         ObjFunction* function = getFrameFunction(frame);
         
         size_t instruction = frame->ip - (&function->chunk.code[0]) - 1;
-        std::cerr << "[line " << function->chunk.getLine(instruction) << "] in ";
+        const Line& line = function->chunk.getLineEntry(instruction);
+        
+        //Code inlined from another function reports the frame that function would have had
+        if(line.inlinedFrom != nullptr) {
+            std::cerr << "[line " << line.line << "] in " << line.inlinedFrom->name->chars() << "()" << std::endl;
+            std::cerr << "[line " << line.callLine << "] in ";
+        } else {
+            std::cerr << "[line " << line.line << "] in ";
+        }
         
         if(function->name == nullptr) {
             std::cerr << "script" << std::endl;
         } else {
-            std::cerr << function->name->chars << "()" << std::endl;
+            std::cerr << function->name->chars() << "()" << std::endl;
         }
     }
     
@@ -720,25 +1009,8 @@ bool VM::callValue(Value callee, int argCount) {
                 
                 return call((Obj*)bound->method, ValueOP::get_value_function(callee), argCount);
             }
-            case OBJ_NATIVE: {
-                ObjNative* native = ValueOP::as_native(callee);
-                
-                if(native->arity != -1 && argCount != native->arity) {
-                    runtimeError("Expected %d arguments but got %d.", native->arity, argCount);
-                    return false;
-                }
-                
-                bool res = std::invoke(native->function, *this, argCount, &stack[stack.size() - 1] - argCount + 1);
-                if(res) {
-                    for(int i = 0; i < argCount; i++) {
-                        stack.pop_back();
-                    }
-                    return true;
-                } else {
-                    runtimeError(ValueOP::as_string(stack[stack.size() - argCount - 1])->chars);
-                    return false;
-                }
-            }
+            case OBJ_NATIVE:
+                return callNative(ValueOP::as_native(callee), argCount);
             case OBJ_CLOSURE:
                 return callClosure(ValueOP::as_closure(callee), argCount);
             case OBJ_FUNCTION:
@@ -764,6 +1036,9 @@ bool VM::callValue(Value callee, int argCount) {
                     case NATIVE_COLLECTION:
                         back[-argCount] = ValueOP::obj_val(ObjCollectionInstance::newCollectionInstance(static_cast<ObjCollectionClass*>(_class), this));
                         break;
+                    case NATIVE_STRING_BUILDER:
+                        back[-argCount] = ValueOP::obj_val(ObjStringBuilderInstance::newStringBuilderInstance(static_cast<ObjStringBuilderClass*>(_class), this));
+                        break;
                     default:
                         // should never be reached;
                         runtimeError("Invalid native class");
@@ -789,6 +1064,33 @@ bool VM::callValue(Value callee, int argCount) {
     return false;
 }
 
+bool VM::callNative(ObjNative* native, int argCount) {
+    if(native->arity != -1 && argCount != native->arity) {
+        runtimeError("Expected %d arguments but got %d.", native->arity, argCount);
+        return false;
+    }
+    
+    //Natives take their arguments as an array with the result slot in front of it. The stack only stores them
+    //contiguously when they do not straddle two of its blocks, otherwise they are copied out and the result back.
+    size_t base = stack.size() - argCount - 1;
+    Value* args = &stack[base];
+    std::vector<Value> buffer;
+    bool contiguous = &stack.back() - args == argCount;
+    if(!contiguous) {
+        buffer.assign(stack.begin() + base, stack.end());
+        args = buffer.data();
+    }
+    
+    bool ok = (this->*native->function)(argCount, args + 1);
+    if(!contiguous) stack[base] = args[0];
+    stack.resize(base + 1);
+    
+    if(!ok) {
+        runtimeError("%s", ValueOP::is_string(stack[base]) ? ValueOP::as_string(stack[base])->chars() : "Error.");
+    }
+    return ok;
+}
+
 bool VM::callClosure(ObjClosure *closure, int argCount) {
     return call((Obj*)closure, closure->function, argCount);
 }
@@ -798,29 +1100,30 @@ bool VM::callFunction(ObjFunction *function, int argCount) {
 }
 
 bool VM::call(Obj* callee, ObjFunction* function, int argCount) {
+    size_t slots = stack.size() - argCount - 1;
     
-    if(argCount < function->arity - function->defaults) {
-        runtimeError("Expected at least %d arguments but got %d.", function->arity - function->defaults, argCount);
-        return false;
-    }
-    if(argCount > function->arity) {
-        runtimeError("Expected at most %d arguments but got %d.", function->arity, argCount);
-        return false;
+    //Calls passing exactly the parameters of a function without defaults need no further checks
+    if(argCount != function->arity || function->defaults != 0) {
+        int required = function->arity - function->defaults;
+        if(argCount < required) {
+            runtimeError("Expected at least %d arguments but got %d.", required, argCount);
+            return false;
+        }
+        if(argCount > function->arity) {
+            runtimeError("Expected at most %d arguments but got %d.", function->arity, argCount);
+            return false;
+        }
+        
+        //The prologue pops a marker for every default parameter that was passed an argument
+        stack.resize(stack.size() + argCount - required, ValueOP::empty_val());
     }
+    
     if(frames.size() == frames.max_size()) {
         runtimeError("Stack overflow.");
         return false;
     }
     
-    if(argCount > function->arity - function->defaults) {
-        for(int i = 0; i < argCount - (function->arity - function->defaults); i++) {
-            push_stack(ValueOP::empty_val());
-        }
-    }
-    
-
-    frames.push_back(CallFrame(callee, &function->chunk.code[0],
-                               stack.size() - argCount - (argCount - (function->arity - function->defaults)) - 1));
+    frames.emplace_back(callee, function->chunk.code.data(), slots);
     return true;
 }
 
@@ -833,6 +1136,14 @@ void VM::defineNative(std::string&& name, NativeFn function, int arity) {
     stack.pop_back();
 }
 
+void VM::defineStringMethod(std::string&& name, NativeFn function, int arity) {
+    push_stack(ValueOP::obj_val(ObjString::copyString(this, std::move(name))));
+    push_stack(ValueOP::obj_val(ObjNative::newNative(function, arity, this)));
+    stringMethods.tableSet(peek(1), peek(0));
+    stack.pop_back();
+    stack.pop_back();
+}
+
 void VM::defineNativeClass(std::string&& name, NativeClassType type) {
     ObjString* obj_name = ObjString::copyString(this, std::move(name));
     push_stack(ValueOP::obj_val(obj_name));
@@ -840,6 +1151,9 @@ void VM::defineNativeClass(std::string&& name, NativeClassType type) {
         case NATIVE_COLLECTION:
             push_stack(ValueOP::obj_val(ObjCollectionClass::newCollectionClass(obj_name, this)));
             break;
+        case NATIVE_STRING_BUILDER:
+            push_stack(ValueOP::obj_val(ObjStringBuilderClass::newStringBuilderClass(obj_name, this)));
+            break;
             
         default:
             // should never reach
@@ -865,11 +1179,11 @@ ObjUpvalue* VM::captureUpvalue(size_t localIndex) {
         return upvalue;
     
     ObjUpvalue* createdUpvalue = ObjUpvalue::newUpvalue(&stack[localIndex], this);
-    createdUpvalue->next = upvalue;
+    createdUpvalue->nextUp = upvalue;
     if(prevUpvalue == nullptr)
         openUpvalues = createdUpvalue;
     else
-        prevUpvalue->next = createdUpvalue;
+        prevUpvalue->nextUp = createdUpvalue;
     
     return createdUpvalue;
 }
@@ -903,7 +1217,7 @@ void VM::defineMethod(ObjString *name) {
 bool VM::bindMethod(ObjClass *_class, ObjString *name) {
     Value method;
     if(!_class->methods.tableGet(ValueOP::obj_val(name), &method)) {
-        runtimeError("Undefined property '%s'.", name->chars.c_str());
+        runtimeError("Undefined property '%s'.", name->chars());
         return false;
     }
     
@@ -928,6 +1242,14 @@ void VM::appendCollection() {
     for(int i = 0; i < collection2->values.count; i++) newcollection->values.writeValueArray(collection2->values.values[i]);
 }
 
+ObjCollectionInstance* VM::newCollection() {
+    Value collection_idx;
+    globalNames.tableGet(ValueOP::obj_val(ObjString::copyString(this, "Collection")), &collection_idx);
+    
+    ObjCollectionClass* collection_class = ValueOP::as_native_subclass<ObjCollectionClass>(globalValues.values[Number::cast_to<size_t>(ValueOP::as_number(collection_idx))]);
+    return ObjCollectionInstance::newCollectionInstance(collection_class, this);
+}
+
 bool VM::isFloatNative(int argCount, Value *args) {
     if (!ValueOP::is_number(args[0])) {
         args[-1] = ValueOP::obj_val(ObjString::copyString(this, "isFloat only accept Number"));
@@ -949,3 +1271,296 @@ bool VM::isWholeNative(int argCount, Value *args) {
     args[-1] = ValueOP::bool_val(!a.is_float);
     return true;
 }
+
+/// Find the first occurrence of a string at or after an index.
+/// Short needles are found by scanning for their first character with memchr and comparing the rest with memcmp,
+/// longer ones with Boyer-Moore-Horspool, which skips ahead by up to the length of the needle on a mismatch.
+/// @return The index of the occurrence, std::string_view::npos if there is none
+static size_t findString(std::string_view haystack, std::string_view needle, size_t start = 0) {
+    size_t m = needle.size();
+    if(start > haystack.size() || m > haystack.size() - start) return std::string_view::npos;
+    if(m == 0) return start;
+    
+    const char* data = haystack.data();
+    const char* end = data + haystack.size() - m + 1;
+    if(m < 8) {
+        for(const char* p = data + start; p < end; p++) {
+            p = (const char*)memchr(p, needle[0], end - p);
+            if(p == nullptr) break;
+            if(memcmp(p + 1, needle.data() + 1, m - 1) == 0) return p - data;
+        }
+        return std::string_view::npos;
+    }
+    
+    size_t skip[256];
+    std::fill(std::begin(skip), std::end(skip), m);
+    for(size_t i = 0; i < m - 1; i++) skip[(uint8_t)needle[i]] = m - 1 - i;
+    
+    for(const char* p = data + start; p < end; p += skip[(uint8_t)p[m - 1]]) {
+        if(p[m - 1] == needle[m - 1] && memcmp(p, needle.data(), m - 1) == 0) return p - data;
+    }
+    return std::string_view::npos;
+}
+
+//STRING METHODS======================================================>
+//The string a method is invoked on is passed in args[-1], which the result replaces
+
+/// Read an index argument of a string method, counting negative indices from the end of the string
+/// @return false if the argument is not a whole number
+static bool stringIndex(Value value, size_t length, long long& index) {
+    if(!ValueOP::is_number(value) || !ValueOP::is_whole_number(value)) return false;
+    
+    index = ValueOP::as_number(value).number.whole;
+    if(index < 0) index += length;
+    return true;
+}
+
+bool VM::stringLengthNative(int argCount, Value* args) {
+    args[-1] = ValueOP::number_val((long long)ValueOP::string_length(args[-1]));
+    return true;
+}
+
+bool VM::stringIndexNative(int argCount, Value* args) {
+    size_t length = ValueOP::string_length(args[-1]);
+    long long index;
+    if(!stringIndex(args[0], length, index)) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "String index must be a whole number."));
+        return false;
+    }
+    if(index < 0 || index >= (long long)length) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "String index out of range."));
+        return false;
+    }
+    
+    args[-1] = ValueOP::obj_val(ObjString::copyString(this, ValueOP::as_string_view(args[-1]).substr(index, 1)));
+    return true;
+}
+
+bool VM::stringSliceNative(int argCount, Value* args) {
+    //Bounds are clamped to the string and nul stands for its start or end, as in s[:3]
+    long long length = ValueOP::string_length(args[-1]);
+    long long bounds[2] = {0, length};
+    for(int i = 0; i < 2; i++) {
+        if(ValueOP::is_nul(args[i])) continue;
+        if(!stringIndex(args[i], length, bounds[i])) {
+            args[-1] = ValueOP::obj_val(ObjString::copyString(this, "Slice bounds must be whole numbers."));
+            return false;
+        }
+        bounds[i] = std::clamp(bounds[i], 0ll, length);
+    }
+    
+    long long end = std::max(bounds[0], bounds[1]);
+    args[-1] = ObjSlice::substring(this, args[-1], bounds[0], end - bounds[0]);
+    return true;
+}
+
+bool VM::stringFindNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "Expected a string to find."));
+        return false;
+    }
+    
+    size_t index = findString(ValueOP::as_string_view(args[-1]), ValueOP::as_string_view(args[0]));
+    args[-1] = ValueOP::number_val(index == std::string_view::npos ? -1ll : (long long)index);
+    return true;
+}
+
+bool VM::stringStartsWithNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "Expected a string prefix."));
+        return false;
+    }
+    
+    std::string_view string = ValueOP::as_string_view(args[-1]);
+    std::string_view prefix = ValueOP::as_string_view(args[0]);
+    args[-1] = ValueOP::bool_val(string.substr(0, prefix.size()) == prefix);
+    return true;
+}
+
+bool VM::stringSplitNative(int argCount, Value* args) {
+    return splitString(args[-1], args[0], args[-1]);
+}
+
+bool VM::splitString(Value string, Value separator, Value& result) {
+    if(!ValueOP::is_string(string) || !ValueOP::is_string(separator) || ValueOP::string_length(separator) == 0) {
+        result = ValueOP::obj_val(ObjString::copyString(this, "Expected a string and a non-empty separator."));
+        return false;
+    }
+    
+    std::string_view chars = ValueOP::as_string_view(string);
+    std::string_view sep = ValueOP::as_string_view(separator);
+    
+    //The parts are counted first so the collection is allocated once
+    size_t count = 1;
+    for(size_t at = findString(chars, sep); at != std::string_view::npos; at = findString(chars, sep, at + sep.size())) count++;
+    
+    ObjCollectionInstance* parts = newCollection();
+    push_stack(ValueOP::obj_val(parts));
+    parts->values.values.reserve(count);
+    
+    //The parts are slices of the string, so splitting copies no characters
+    for(size_t start = 0;;) {
+        size_t end = std::min(findString(chars, sep, start), chars.size());
+        parts->values.writeValueArray(ObjSlice::substring(this, string, start, end - start));
+        if(end == chars.size()) break;
+        start = end + sep.size();
+    }
+    
+    stack.pop_back();
+    result = ValueOP::obj_val(parts);
+    return true;
+}
+
+//STRING LIBRARY======================================================>
+
+bool VM::indexOfNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0]) || !ValueOP::is_string(args[1])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "indexOf expects two strings."));
+        return false;
+    }
+    
+    size_t index = findString(ValueOP::as_string_view(args[0]), ValueOP::as_string_view(args[1]));
+    args[-1] = ValueOP::number_val(index == std::string_view::npos ? -1ll : (long long)index);
+    return true;
+}
+
+bool VM::containsNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0]) || !ValueOP::is_string(args[1])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "contains expects two strings."));
+        return false;
+    }
+    
+    args[-1] = ValueOP::bool_val(findString(ValueOP::as_string_view(args[0]), ValueOP::as_string_view(args[1])) != std::string_view::npos);
+    return true;
+}
+
+bool VM::splitNative(int argCount, Value* args) {
+    return splitString(args[0], args[1], args[-1]);
+}
+
+bool VM::replaceNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0]) || !ValueOP::is_string(args[1]) || !ValueOP::is_string(args[2]) ||
+       ValueOP::string_length(args[1]) == 0) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "replace expects three strings and a non-empty pattern."));
+        return false;
+    }
+    
+    std::string_view chars = ValueOP::as_string_view(args[0]);
+    std::string_view pattern = ValueOP::as_string_view(args[1]);
+    std::string_view replacement = ValueOP::as_string_view(args[2]);
+    
+    std::vector<size_t> matches;
+    for(size_t at = findString(chars, pattern); at != std::string_view::npos; at = findString(chars, pattern, at + pattern.size())) {
+        matches.push_back(at);
+    }
+    if(matches.empty()) {
+        args[-1] = args[0];
+        return true;
+    }
+    
+    //The length of the result is known up front, so it is written straight into the new string
+    ObjString* result = ObjString::allocateString(this, chars.size() + matches.size() * replacement.size() - matches.size() * pattern.size());
+    char* out = result->chars();
+    size_t copied = 0;
+    for(size_t at : matches) {
+        memcpy(out, chars.data() + copied, at - copied);
+        out += at - copied;
+        memcpy(out, replacement.data(), replacement.size());
+        out += replacement.size();
+        copied = at + pattern.size();
+    }
+    memcpy(out, chars.data() + copied, chars.size() - copied);
+    
+    args[-1] = ValueOP::obj_val(result);
+    return true;
+}
+
+bool VM::joinNative(int argCount, Value* args) {
+    if(!ValueOP::is_obj(args[0]) || !ValueOP::is_native_instance(args[0]) ||
+       !ValueOP::is_native_subinstance(args[0], NATIVE_COLLECTION_INSTANCE) || !ValueOP::is_string(args[1])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "join expects a collection and a separator string."));
+        return false;
+    }
+    
+    ObjCollectionInstance* collection = ValueOP::as_native_subinstance<ObjCollectionInstance>(args[0]);
+    std::string_view separator = ValueOP::as_string_view(args[1]);
+    
+    //Values that are not strings are formatted like toString does
+    std::string buffer;
+    for(size_t i = 0; i < collection->values.count; i++) {
+        if(i > 0) buffer += separator;
+        Value value = collection->values.values[i];
+        if(ValueOP::is_string(value)) buffer += ValueOP::as_string_view(value);
+        else ValueOP::append_string(value, buffer);
+    }
+    
+    args[-1] = ValueOP::obj_val(ObjString::newString(this, buffer));
+    return true;
+}
+
+bool VM::trimNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "trim expects a string."));
+        return false;
+    }
+    
+    std::string_view chars = ValueOP::as_string_view(args[0]);
+    size_t start = 0, end = chars.size();
+    while(start < end && isspace((unsigned char)chars[start])) start++;
+    while(end > start && isspace((unsigned char)chars[end - 1])) end--;
+    
+    args[-1] = ObjSlice::substring(this, args[0], start, end - start);
+    return true;
+}
+
+/// Map the characters of a string into a new string of the same length
+/// @param args Arguments of the native, the string is args[0] and the result goes into args[-1]
+template <typename F>
+static bool mapString(VM* vm, Value* args, const char* name, F map) {
+    if(!ValueOP::is_string(args[0])) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(vm, std::string(name) + " expects a string."));
+        return false;
+    }
+    
+    std::string_view chars = ValueOP::as_string_view(args[0]);
+    ObjString* result = ObjString::allocateString(vm, chars.size());
+    std::transform(chars.begin(), chars.end(), result->chars(), map);
+    args[-1] = ValueOP::obj_val(result);
+    return true;
+}
+
+bool VM::upperNative(int argCount, Value* args) {
+    return mapString(this, args, "upper", [](char c) { return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c; });
+}
+
+bool VM::lowerNative(int argCount, Value* args) {
+    return mapString(this, args, "lower", [](char c) { return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c; });
+}
+
+bool VM::repeatNative(int argCount, Value* args) {
+    if(!ValueOP::is_string(args[0]) || !ValueOP::is_number(args[1]) || !ValueOP::is_whole_number(args[1]) ||
+       ValueOP::as_number(args[1]).number.whole < 0) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "repeat expects a string and a whole number that is not negative."));
+        return false;
+    }
+    
+    std::string_view chars = ValueOP::as_string_view(args[0]);
+    size_t times = ValueOP::as_number(args[1]).number.whole;
+    if(chars.size() != 0 && times > SIZE_MAX / 2 / chars.size()) {
+        args[-1] = ValueOP::obj_val(ObjString::copyString(this, "repeat result is too long."));
+        return false;
+    }
+    
+    //The string is copied once and then doubled, so the copies grow exponentially
+    size_t length = chars.size() * times;
+    ObjString* result = ObjString::allocateString(this, length);
+    if(length > 0) {
+        memcpy(result->chars(), chars.data(), chars.size());
+        for(size_t filled = chars.size(); filled < length; filled *= 2) {
+            memcpy(result->chars() + filled, result->chars(), std::min(filled, length - filled));
+        }
+    }
+    
+    args[-1] = ValueOP::obj_val(result);
+    return true;
+}
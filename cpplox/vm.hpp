@@ -8,6 +8,8 @@
 #include "chunk.hpp"
 #include "table.hpp"
 #include "object.hpp"
+#include "module.hpp"
+#include "flags.hpp"
 
 #define STACK_MAX 256
 
@@ -29,6 +31,26 @@ public:
     CallFrame(Obj* function, uint8_t* ip, size_t slots);
 };
 
+/// Buffer for the output of print, so that printing does not cost a system call per line.
+/// Writes out once full, and whenever flush is called. The VM flushes after every print while line buffered,
+/// and before anything that hands the terminal to someone else: exiting, reporting a runtime error, or reading input.
+class OutputBuffer : public std::streambuf {
+    char buffer[OUTPUT_BUFFER_SIZE];
+    
+protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+    
+public:
+    /// Flush after every print instead of once the buffer is full. Defaults to whether stdout is a terminal.
+    bool lineBuffered;
+    
+    OutputBuffer();
+    
+    /// Write out everything buffered so far
+    void flush();
+};
+
 class VM {
     
     InterpretResult run();
@@ -44,16 +66,40 @@ class VM {
     template <typename T, typename U>
     InterpretResult binary_op(Value (*valuetype)(T),std::function<T (U, U)> func);
     
-    bool isFalsey(Value value);
+    /// Apply a bitwise operator to the two values on top of the stack, reporting an error unless both are whole numbers
+    /// @param shift Whether the operator is a shift, whose right operand must be between 0 and 63
+    /// @return false if a runtime error occurred
+    template <typename F>
+    bool bitwise_op(F func, bool shift = false);
+    
+    /// Apply an operator to the two numbers on top of the stack, which the optimizer expects to be whole numbers.
+    /// @param checked Computes the whole result and returns true on overflow, like __builtin_add_overflow
+    /// @param fallback Generic operator for when an operand is a float or the result overflows
+    template <typename F, typename G>
+    void whole_op(F checked, G fallback);
+    
+    /// Apply an operator to the two numbers on top of the stack, which the optimizer proved to be numbers
+    template <typename T, typename F>
+    void number_op(Value (*valuetype)(T), F func);
     
     void concatenate();
     
+    /// Join the parts of an interpolated string on top of the stack into one string, replacing them.
+    /// Values other than strings are formatted like print formats them.
+    /// @param count Number of parts
+    void buildString(int count);
+    
+    /// Scratch space buildString formats values into, kept between calls to reuse its capacity
+    std::string formatBuffer;
+    
     void runtimeError(const std::string& format, ... );
     
     bool callValue(Value callee, int argCount);
     
     bool call(Obj* callee, ObjFunction* function, int argCount);
     
+    bool callNative(ObjNative* native, int argCount);
+    
     bool callClosure(ObjClosure* closure, int argCount);
     
     bool callFunction(ObjFunction* function, int argCount);
@@ -62,6 +108,9 @@ class VM {
     
     void defineNativeClass(std::string&& name, NativeClassType type);
     
+    /// Define a method every string has, implemented by a native that finds the string in args[-1]
+    void defineStringMethod(std::string&& name, NativeFn function, int arity);
+    
     ObjUpvalue* captureUpvalue(size_t localIndex);
     
     void closeUpvalues(Value* last);
@@ -78,8 +127,18 @@ class VM {
     
     bool invokeFromClass(ObjClass* _class, ObjString* name, int argCount, bool interrupt);
     
+    bool invokeString(ObjString* name, int argCount, bool interrupt);
+    
     void appendCollection();
     
+    /// Create an empty instance of the global Collection class
+    ObjCollectionInstance* newCollection();
+    
+    /// Split a string at every occurrence of a separator into a collection of slices
+    /// @param result Set to the collection, or to the error message
+    /// @return false if the arguments are not two strings
+    bool splitString(Value string, Value separator, Value& result);
+    
    
 public:
     Compiler* current;
@@ -100,22 +159,33 @@ public:
     Table strings;
     Table globalNames;
     ValueArray globalValues;
+    /// Methods of strings, ropes and slices, by name
+    Table stringMethods;
     std::unordered_map<uint8_t, Value> cache;
     
+    ModuleLoader modules;
+    
     ObjString* initString;
     
     Obj* objects;
     
     bool marker;
     
+    OutputBuffer outputBuffer;
+    /// Stream print writes to, backed by outputBuffer
+    std::ostream output;
+    
     VM();
     void freeVM();
-    InterpretResult interpret(const std::string& source);
+    InterpretResult interpret(std::string source);
     
     void push_stack(Value value);
     
     Value peek(int distance);
     
+    /// nul and false are falsey, every other value is truthy. Also used by the compiler to fold constant conditions.
+    static bool isFalsey(Value value);
+    
     // Native functions
     
     bool clockNative(int argCount, Value *args);
@@ -126,6 +196,9 @@ public:
     
     bool getLineNative(int argCount, Value* args);
     
+    /// Write out everything printed so far
+    bool flushNative(int argCount, Value* args);
+    
     bool hasFieldNative(int argCount, Value* args);
     
     bool getFieldNative(int argCount, Value* args);
@@ -139,6 +212,40 @@ public:
     bool isFloatNative(int argCount, Value *args);
     
     bool isWholeNative(int argCount, Value *args);
+    
+    // String methods
+    
+    bool stringLengthNative(int argCount, Value* args);
+    
+    bool stringIndexNative(int argCount, Value* args);
+    
+    bool stringSliceNative(int argCount, Value* args);
+    
+    bool stringFindNative(int argCount, Value* args);
+    
+    bool stringStartsWithNative(int argCount, Value* args);
+    
+    bool stringSplitNative(int argCount, Value* args);
+    
+    // String library
+    
+    bool indexOfNative(int argCount, Value* args);
+    
+    bool containsNative(int argCount, Value* args);
+    
+    bool splitNative(int argCount, Value* args);
+    
+    bool replaceNative(int argCount, Value* args);
+    
+    bool joinNative(int argCount, Value* args);
+    
+    bool trimNative(int argCount, Value* args);
+    
+    bool upperNative(int argCount, Value* args);
+    
+    bool lowerNative(int argCount, Value* args);
+    
+    bool repeatNative(int argCount, Value* args);
 };
 
 